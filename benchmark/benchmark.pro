@@ -0,0 +1,74 @@
+QT += core gui widgets concurrent
+TARGET = sekvyu-benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+CONFIG(tracing) {
+    DEFINES += SEKVYU_TRACING
+}
+
+
+# build configuration-specific
+CONFIG(debug, debug|release) {
+    MY_BUILD_CONFIG = debug
+}
+CONFIG(release, debug|release) {
+    MY_BUILD_CONFIG = release
+}
+# platform-specific
+contains(QMAKE_TARGET.arch, x86_64) {
+    MY_BUILD_ARCH = x64
+}
+else {
+    MY_BUILD_ARCH = win32
+}
+
+
+# headers/libraries; Extract7z is expected to have been built along with sekvyu.pro
+INCLUDEPATH += "../extract7z/include/" "../sekvyu/"
+win32 {
+    LIBS += OleAut32.lib User32.lib Advapi32.lib Psapi.lib "../extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib"
+}
+unix {
+    LIBS += "../extract7z/bin/$${MY_BUILD_CONFIG}/libextract7z.a"
+}
+
+# output/intermediate folders
+DESTDIR = ../build/bin/$${MY_BUILD_CONFIG}
+MOC_DIR = ../build/moc/benchmark/$${MY_BUILD_CONFIG}
+OBJECTS_DIR = ../build/obj/benchmark/$${MY_BUILD_CONFIG}
+PRECOMPILED_DIR = ../build/benchmark
+
+
+SOURCES += \
+    main.cpp \
+    corpus.cpp \
+    ../sekvyu/animationplayer.cpp \
+    ../sekvyu/archive.cpp \
+    ../sekvyu/archiveimageview.cpp \
+    ../sekvyu/fileformat.cpp \
+    ../sekvyu/imagecache.cpp \
+    ../sekvyu/imagedecoder.cpp \
+    ../sekvyu/imagescaler.cpp \
+    ../sekvyu/securearena.cpp \
+    ../sekvyu/striplayout.cpp \
+    ../sekvyu/taskscheduler.cpp \
+    ../sekvyu/tilecache.cpp \
+    ../sekvyu/trace.cpp
+
+HEADERS += \
+    corpus.h \
+    ../sekvyu/animationplayer.h \
+    ../sekvyu/archive.h \
+    ../sekvyu/archiveimageview.h \
+    ../sekvyu/fileformat.h \
+    ../sekvyu/imagecache.h \
+    ../sekvyu/imagedecoder.h \
+    ../sekvyu/imagescaler.h \
+    ../sekvyu/securearena.h \
+    ../sekvyu/striplayout.h \
+    ../sekvyu/taskscheduler.h \
+    ../sekvyu/tilecache.h \
+    ../sekvyu/trace.h
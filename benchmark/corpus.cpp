@@ -0,0 +1,149 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "corpus.h"
+
+#include <cstdint>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QProcess>
+
+
+
+namespace {
+
+
+constexpr int k_sevenZipTimeoutMsec = 30 * 60 * 1000;
+
+
+// deterministic across platforms and Qt versions, unlike QRandomGenerator seeding
+inline uint32_t NextRandom(uint32_t& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+
+}  // unnamed namespace
+
+
+
+std::vector<CorpusSpec> Corpus::GetDefaultSpecs(int smallPageCount, int hugePageCount)
+{
+	std::vector<CorpusSpec> specs;
+	for (const QByteArray& format : { QByteArray("jpg"), QByteArray("png") }) {
+		for (bool isHuge : { false, true }) {
+			for (bool isEncrypted : { false, true }) {
+				for (bool isSolid : { true, false }) {
+					CorpusSpec spec;
+					spec.name = QString("%1-%2-%3-%4")
+						.arg(QString(format))
+						.arg(isHuge ? "huge" : "small")
+						.arg(isEncrypted ? "encrypted" : "plain")
+						.arg(isSolid ? "solid" : "nonsolid");
+					spec.isSolid = isSolid;
+					spec.isEncrypted = isEncrypted;
+					spec.imageFormat = format;
+					spec.pageSize = isHuge ? QSize(6000, 8500) : QSize(1200, 1700);
+					spec.pageCount = isHuge ? hugePageCount : smallPageCount;
+					specs.push_back(spec);
+				}
+			}
+		}
+	}
+	return specs;
+}
+
+
+QString Corpus::GetPassword()
+{
+	return "sekvyu-benchmark";
+}
+
+
+QString Corpus::Prepare(const CorpusSpec& spec, const QString& dir, const QString& sevenZipPath, QString& outError)
+{
+	QDir corpusDir(dir);
+	const auto& archivePath = corpusDir.absoluteFilePath(QString("%1-%2.7z").arg(spec.name).arg(spec.pageCount));
+	if (QFileInfo::exists(archivePath))
+		return archivePath;
+
+	// pages are written to disk only to be packed; they are synthetic, so nothing secret leaks
+	const auto& pagesDirName = spec.name + "-pages";
+	corpusDir.mkpath(pagesDirName);
+	QDir pagesDir(corpusDir.absoluteFilePath(pagesDirName));
+	for (int i = 0; i < spec.pageCount; ++i) {
+		const auto& pagePath = pagesDir.absoluteFilePath(QString("%1.%2").arg(i + 1, 4, 10, QChar('0')).arg(QString(spec.imageFormat)));
+		if (!MakePage(spec.pageSize, i + 1).save(pagePath, spec.imageFormat.constData(), 90)) {
+			outError = "Failed to write " + pagePath;
+			return QString();
+		}
+	}
+
+	// one non-image entry for Archive::Filter to drop
+	QFile readme(pagesDir.absoluteFilePath("readme.txt"));
+	if (readme.open(QIODevice::WriteOnly))
+		readme.write("Synthetic benchmark corpus.\n");
+	readme.close();
+
+	QStringList args = { "a", "-t7z", "-mx=1", spec.isSolid ? "-ms=on" : "-ms=off" };
+	if (spec.isEncrypted)
+		args << ("-p" + GetPassword()) << "-mhe=on";
+	args << (archivePath + ".tmp") << (pagesDir.absolutePath() + "/*");
+
+	QProcess sevenZip;
+	sevenZip.start(sevenZipPath, args);
+	if (!sevenZip.waitForFinished(k_sevenZipTimeoutMsec) || sevenZip.exitStatus() != QProcess::NormalExit || sevenZip.exitCode() != 0) {
+		outError = QString("%1 failed: %2").arg(sevenZipPath).arg(QString::fromLocal8Bit(sevenZip.readAllStandardError()));
+		QFile::remove(archivePath + ".tmp");
+		return QString();
+	}
+
+	pagesDir.removeRecursively();
+	QFile::rename(archivePath + ".tmp", archivePath);  // only complete archives are reused
+	return archivePath;
+}
+
+
+QImage Corpus::MakePage(const QSize& size, int pageNumber)
+{
+	QImage page(size, QImage::Format_RGB32);
+	uint32_t state = static_cast<uint32_t>(pageNumber) * 2654435761u;
+	for (int y = 0; y < size.height(); ++y) {
+		auto line = reinterpret_cast<uint32_t*>(page.scanLine(y));
+		const int base = (y * 192) / size.height();
+		for (int x = 0; x < size.width(); ++x) {
+			const int noise = static_cast<int>(NextRandom(state) & 0x1F);
+			const int r = base + noise;
+			const int g = (x * 192) / size.width() + noise;
+			const int b = (pageNumber * 37 + noise) & 0xFF;
+			line[x] = 0xFF000000u | (r << 16) | (g << 8) | b;
+		}
+	}
+
+	QPainter painter(&page);
+	QFont font = painter.font();
+	font.setPixelSize(size.height() / 8);
+	painter.setFont(font);
+	painter.setPen(Qt::white);
+	painter.drawText(page.rect(), Qt::AlignCenter, QString::number(pageNumber));
+	return page;
+}
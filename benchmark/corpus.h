@@ -0,0 +1,59 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+
+
+struct CorpusSpec
+{
+	QString name;
+	bool isSolid;
+	bool isEncrypted;
+	QByteArray imageFormat;  // "jpg" or "png"
+	QSize pageSize;
+	int pageCount;
+};
+
+
+
+// Synthetic 7z archives for benchmarking, made with the 7z command-line tool. Pages are noisy
+// gradients so that they compress like scans do rather than like flat colour.
+class Corpus
+{
+public:
+	static std::vector<CorpusSpec> GetDefaultSpecs(int smallPageCount, int hugePageCount);
+	static QString GetPassword();
+
+	// returns the path of the archive, which is only made if it does not exist yet
+	static QString Prepare(const CorpusSpec& spec, const QString& dir, const QString& sevenZipPath, QString& outError);
+
+	static QImage MakePage(const QSize& size, int pageNumber);
+};
+
+
+
+#endif // CORPUS_H
@@ -0,0 +1,356 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless end-to-end benchmark: opens synthetic archives, pages through them in an offscreen
+// ArchiveImageView and saves a few pages, then prints the timings as JSON.
+
+#ifdef _WIN32
+	#define NOMINMAX
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif  // _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QTimer>
+
+// Extract7Z
+#include <Buffer.h>
+
+#include "archive.h"
+#include "archiveimageview.h"
+#include "corpus.h"
+#include "fileformat.h"
+#include "imagescaler.h"
+#include "trace.h"
+
+
+
+namespace {
+
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int k_pageTimeoutMsec = 60 * 1000;
+constexpr int k_numSavedPages = 5;
+constexpr int k_numScalerRuns = 5;
+constexpr int k_defaultDwellMsec = 250;  // longer than the view's settle interval, so turns are not scrubbing
+constexpr int k_scrubIntervalMsec = 33;  // about the auto-repeat rate of a held key
+
+
+double GetElapsedMsec(Clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+
+// nearest-rank
+double GetPercentile(std::vector<double> samples, double percent)
+{
+	if (samples.empty())
+		return 0.0;
+	std::sort(samples.begin(), samples.end());
+	auto rank = static_cast<size_t>(percent / 100.0 * samples.size() + 0.5);
+	return samples[std::min(std::max<size_t>(rank, 1), samples.size()) - 1];
+}
+
+
+// of the whole process so far; run one case per process for per-case figures
+double GetPeakRssMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) == FALSE)
+		return 0.0;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	return usage.ru_maxrss / 1024.0;  // in KB on Linux
+#endif  // _WIN32
+}
+
+
+// the viewer's check by content
+bool IsSupportedImage(const FileRecord& frec, FileFormat::Type fileType)
+{
+	return frec.data && frec.data->GetSize() > 0 && FileFormat::IsImage(fileType);
+}
+
+
+// Runs action and spins the event loop until the view shows the final frame of index. Connecting
+// first catches frames which are already cached and shown from within action.
+bool RunUntilPageShown(ArchiveImageView& view, size_t index, const std::function<void()>& action)
+{
+	QEventLoop loop;
+	bool isShown = false;
+	auto connection = QObject::connect(&view, &ArchiveImageView::pageShown, &loop, [&loop, &isShown, index](size_t shownIndex) {
+		if (shownIndex == index) {
+			isShown = true;
+			loop.quit();
+		}
+	} );
+
+	action();
+	if (!isShown) {
+		QTimer::singleShot(k_pageTimeoutMsec, &loop, &QEventLoop::quit);
+		loop.exec();
+	}
+	QObject::disconnect(connection);
+	return isShown;
+}
+
+
+// lets prefetching run as if the page were being read
+void Dwell(int msec)
+{
+	if (msec <= 0)
+		return;
+	QEventLoop loop;
+	QTimer::singleShot(msec, &loop, &QEventLoop::quit);
+	loop.exec();
+}
+
+
+QJsonObject RunCase(const CorpusSpec& spec, const QString& archivePath, const QSize& viewSize, int dwellMsec, const QString& saveDir)
+{
+	QJsonObject result;
+	result["name"] = spec.name;
+	result["pages"] = spec.pageCount;
+	result["archive_bytes"] = static_cast<double>(QFileInfo(archivePath).size());
+
+	const auto start = Clock::now();
+	auto archive = std::make_shared<Archive>();
+	auto openResult = archive->Open(archivePath, [](std::wstring& outPasswd) -> bool {
+		outPasswd = Corpus::GetPassword().toStdWString();
+		return true;
+	} );
+	result["open_ms"] = GetElapsedMsec(start);
+	if (openResult != Archive::OpenResult::Success) {
+		result["error"] = QString("Archive::Open failed with %1").arg(static_cast<int>(openResult));
+		return result;
+	}
+
+	auto filterStart = Clock::now();
+	archive->Filter(IsSupportedImage);
+	result["filter_ms"] = GetElapsedMsec(filterStart);
+	if (archive->GetFileCount() == 0) {
+		result["error"] = "no image left after filtering";
+		return result;
+	}
+
+	ArchiveImageView view(nullptr);
+	view.resize(viewSize);
+	view.show();
+
+	auto firstImageStart = Clock::now();
+	if (!RunUntilPageShown(view, 0, [&view, &archive]() { view.setArchive(archive); } )) {
+		result["error"] = "timed out waiting for the first page";
+		return result;
+	}
+	result["first_image_ms"] = GetElapsedMsec(firstImageStart);
+	result["time_to_first_image_ms"] = GetElapsedMsec(start);
+
+	std::vector<double> latencies;
+	for (size_t index = 1; index < archive->GetFileCount(); ++index) {
+		Dwell(dwellMsec);
+		auto flipStart = Clock::now();
+		if (!RunUntilPageShown(view, index, [&view]() { view.rotate(ArchiveImageView::Rotation::Next); } )) {
+			result["error"] = QString("timed out waiting for page %1").arg(index + 1);
+			break;
+		}
+		latencies.push_back(GetElapsedMsec(flipStart));
+	}
+	QJsonObject navigation;
+	navigation["count"] = static_cast<int>(latencies.size());
+	navigation["p50_ms"] = GetPercentile(latencies, 50);
+	navigation["p90_ms"] = GetPercentile(latencies, 90);
+	navigation["p99_ms"] = GetPercentile(latencies, 99);
+	navigation["max_ms"] = latencies.empty() ? 0.0 : *std::max_element(latencies.cbegin(), latencies.cend());
+	result["navigation"] = navigation;
+
+	// back to the first page as if a key were held, which the view treats as scrubbing
+	const size_t numScrubSteps = archive->GetFileCount() - 1;
+	if (!result.contains("error") && numScrubSteps > 0) {
+		Dwell(dwellMsec);
+		auto scrubStart = Clock::now();
+		for (size_t step = 1; step < numScrubSteps; ++step) {
+			view.rotate(ArchiveImageView::Rotation::Previous);
+			Dwell(k_scrubIntervalMsec);
+		}
+		auto settleStart = Clock::now();
+		if (RunUntilPageShown(view, 0, [&view]() { view.rotate(ArchiveImageView::Rotation::Previous); } )) {
+			QJsonObject scrubbing;
+			scrubbing["steps"] = static_cast<int>(numScrubSteps);
+			scrubbing["total_ms"] = GetElapsedMsec(scrubStart);
+			scrubbing["settle_ms"] = GetElapsedMsec(settleStart);  // from the last step to the final frame
+			result["scrubbing"] = scrubbing;
+		}
+		else
+			result["error"] = "timed out waiting for the first page after scrubbing";
+	}
+
+	double savedBytes = 0;
+	auto saveStart = Clock::now();
+	const auto numSaved = std::min<size_t>(k_numSavedPages, archive->GetFileCount());
+	for (size_t index = 0; index < numSaved; ++index) {
+		if (archive->Save(index, QDir(saveDir).absoluteFilePath(QString::number(index))))
+			savedBytes += static_cast<double>(archive->GetFileData(index)->GetSize());
+	}
+	result["save_ms"] = GetElapsedMsec(saveStart);
+	result["save_bytes"] = savedBytes;
+
+	result["peak_rss_mb"] = GetPeakRssMB();
+	return result;
+}
+
+
+// ImageScaler at each SIMD level the CPU has, against Qt's smooth scaling
+QJsonArray RunScalerComparison()
+{
+	const QImage& source = Corpus::MakePage(QSize(5000, 7000), 1);
+	const QSize target(800, 1120);
+
+	auto measure = [](const std::function<void()>& func) -> double {
+		double best = 0.0;
+		for (int i = 0; i < k_numScalerRuns; ++i) {
+			auto start = Clock::now();
+			func();
+			double elapsed = GetElapsedMsec(start);
+			best = i == 0 ? elapsed : std::min(best, elapsed);
+		}
+		return best;
+	};
+
+	QJsonArray results;
+	const std::pair<ImageScaler::SimdLevel, const char*> levels[] = {
+		{ ImageScaler::SimdLevel::None, "scaler-scalar" },
+		{ ImageScaler::SimdLevel::Sse2, "scaler-sse2" },
+		{ ImageScaler::SimdLevel::Avx2, "scaler-avx2" }
+	};
+	for (const auto& level : levels) {
+		if (level.first > ImageScaler::GetSimdLevel())
+			break;
+		QJsonObject result;
+		result["name"] = level.second;
+		result["best_ms"] = measure([&source, &target, &level]() { ImageScaler::Downscale(source, target, level.first); } );
+		results.append(result);
+	}
+
+	QJsonObject qtResult;
+	qtResult["name"] = "qt-smooth";
+	qtResult["best_ms"] = measure([&source, &target]() { source.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation); } );
+	results.append(qtResult);
+	return results;
+}
+
+
+}  // unnamed namespace
+
+
+
+int main(int argc, char* argv[])
+{
+	// no window system needed unless asked for
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	Trace::Initialize();
+	QApplication app(argc, argv);
+	QCoreApplication::setApplicationName("sekvyu-benchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("End-to-end benchmark of Sekvyu on synthetic 7z archives.");
+	parser.addHelpOption();
+	QCommandLineOption corpusDirOption("corpus-dir", "Where generated archives are kept and reused.", "dir", QDir::temp().absoluteFilePath("sekvyu-benchmark-corpus"));
+	QCommandLineOption sevenZipOption("7z", "The 7z command-line tool used to make archives.", "path", "7z");
+	QCommandLineOption caseOption("case", "Only runs cases whose name contains this text.", "text");
+	QCommandLineOption smallPagesOption("small-pages", "Number of pages in archives of small pages.", "count", "40");
+	QCommandLineOption hugePagesOption("huge-pages", "Number of pages in archives of huge pages.", "count", "6");
+	QCommandLineOption dwellOption("dwell", "Milliseconds spent on each page before turning it; under 200 the turns count as scrubbing.", "msec", QString::number(k_defaultDwellMsec));
+	QCommandLineOption outputOption("output", "Writes JSON there instead of to stdout.", "file");
+	QCommandLineOption noScalerOption("no-scaler", "Skips the scaler comparison.");
+	QCommandLineOption noReadAheadOption("no-read-ahead", "Opens archives without the read-ahead hint, for comparison.");
+	parser.addOptions({ corpusDirOption, sevenZipOption, caseOption, smallPagesOption, hugePagesOption, dwellOption, outputOption, noScalerOption, noReadAheadOption });
+	parser.process(app);
+	if (parser.isSet(noReadAheadOption))
+		qputenv("SEKVYU_NO_READ_AHEAD", "1");
+
+	const auto& corpusDir = parser.value(corpusDirOption);
+	QDir().mkpath(corpusDir);
+	QTemporaryDir saveDir;
+
+	QJsonArray cases;
+	const auto& specs = Corpus::GetDefaultSpecs(parser.value(smallPagesOption).toInt(), parser.value(hugePagesOption).toInt());
+	for (const auto& spec : specs) {
+		if (parser.isSet(caseOption) && !spec.name.contains(parser.value(caseOption)))
+			continue;
+
+		fprintf(stderr, "%s\n", qPrintable(spec.name));
+		QString error;
+		const auto& archivePath = Corpus::Prepare(spec, corpusDir, parser.value(sevenZipOption), error);
+		if (archivePath.isEmpty()) {
+			QJsonObject result;
+			result["name"] = spec.name;
+			result["error"] = error;
+			cases.append(result);
+			continue;
+		}
+		cases.append(RunCase(spec, archivePath, QSize(1280, 800), parser.value(dwellOption).toInt(), saveDir.path()));
+	}
+
+	QJsonObject report;
+	report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+	report["qt_version"] = qVersion();
+	report["read_ahead"] = !parser.isSet(noReadAheadOption);
+	report["cases"] = cases;
+	if (!parser.isSet(noScalerOption))
+		report["scaler"] = RunScalerComparison();
+
+	const auto& json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+	if (parser.isSet(outputOption)) {
+		QSaveFile file(parser.value(outputOption));
+		if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+			fprintf(stderr, "Failed to write %s\n", qPrintable(parser.value(outputOption)));
+			return 1;
+		}
+	}
+	else
+		fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+
+	Trace::Finish();
+	return 0;
+}
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+git log -n 1 --format=format:"#define GIT_HEAD_REV \"%H\"%n" HEAD > sekvyu/git_tmp.h
+
+if cmp -s sekvyu/git_tmp.h sekvyu/git.h; then
+	rm sekvyu/git_tmp.h
+else
+	mv -f sekvyu/git_tmp.h sekvyu/git.h
+fi
@@ -1,9 +1,14 @@
 
-QT += core gui widgets
+QT += core gui widgets concurrent
 TARGET = sekvyu
 TEMPLATE = app
 DEFINES += QT_DEPRECATED_WARNINGS QT_DISABLE_DEPRECATED_BEFORE=0x060000
 
+# "qmake CONFIG+=tracing" builds in timing spans; see sekvyu/trace.h
+CONFIG(tracing) {
+    DEFINES += SEKVYU_TRACING
+}
+
 
 # build configuration-specific
 CONFIG(debug, debug|release) {
@@ -25,7 +30,13 @@ else {
 
 # headers/libraries
 INCLUDEPATH += "./extract7z/include/"
-LIBS += OleAut32.lib User32.lib Advapi32.lib "extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib"
+win32 {
+    LIBS += OleAut32.lib User32.lib Advapi32.lib "extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib"
+}
+unix {
+    # Extract7z has no project file for other platforms yet and needs to be built separately
+    LIBS += "extract7z/bin/$${MY_BUILD_CONFIG}/libextract7z.a"
+}
 
 # output/intermediate folders
 DESTDIR = build/bin/$${MY_BUILD_CONFIG}
@@ -36,28 +47,59 @@ UI_DIR = build/ui/
 PRECOMPILED_DIR = build  # prevent qmake from auto-generating debug and release
 
 # pre-build events
-extract7z.target = extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib
-extract7z.commands = msbuild extract7z\extract7z.vcxproj /p:Configuration=$${MY_BUILD_CONFIG};Platform=$${MY_BUILD_ARCH}
-extract7z.depends = FORCE
+win32 {
+    extract7z.target = extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib
+    extract7z.commands = msbuild extract7z\extract7z.vcxproj /p:Configuration=$${MY_BUILD_CONFIG};Platform=$${MY_BUILD_ARCH}
+    extract7z.depends = FORCE
+    git_header.commands = gen_git_header.bat
+    PRE_TARGETDEPS += extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib
+    QMAKE_EXTRA_TARGETS += extract7z
+}
+unix {
+    git_header.commands = sh gen_git_header.sh
+}
 git_header.target = sekvyu/git.h
-git_header.commands = gen_git_header.bat
 git_header.depends = FORCE
-PRE_TARGETDEPS += extract7z/bin/$${MY_BUILD_ARCH}/$${MY_BUILD_CONFIG}/extract7z.lib sekvyu/git.h
-QMAKE_EXTRA_TARGETS += extract7z git_header
+PRE_TARGETDEPS += sekvyu/git.h
+QMAKE_EXTRA_TARGETS += git_header
 
 
 SOURCES += \
     sekvyu/main.cpp \
+    sekvyu/animationplayer.cpp \
     sekvyu/mainwindow.cpp \
     sekvyu/fileformat.cpp \
     sekvyu/archiveimageview.cpp \
-    sekvyu/archive.cpp
+    sekvyu/archive.cpp \
+    sekvyu/imagecache.cpp \
+    sekvyu/imagescaler.cpp \
+    sekvyu/securearena.cpp \
+    sekvyu/passwordcache.cpp \
+    sekvyu/imagedecoder.cpp \
+    sekvyu/striplayout.cpp \
+    sekvyu/taskscheduler.cpp \
+    sekvyu/thumbnailmodel.cpp \
+    sekvyu/thumbnailview.cpp \
+    sekvyu/tilecache.cpp \
+    sekvyu/trace.cpp
 
 HEADERS += \
+    sekvyu/animationplayer.h \
     sekvyu/mainwindow.h \
     sekvyu/fileformat.h \
     sekvyu/archiveimageview.h \
-    sekvyu/archive.h
+    sekvyu/archive.h \
+    sekvyu/imagecache.h \
+    sekvyu/imagescaler.h \
+    sekvyu/securearena.h \
+    sekvyu/passwordcache.h \
+    sekvyu/imagedecoder.h \
+    sekvyu/striplayout.h \
+    sekvyu/taskscheduler.h \
+    sekvyu/thumbnailmodel.h \
+    sekvyu/thumbnailview.h \
+    sekvyu/tilecache.h \
+    sekvyu/trace.h
 
 FORMS += \
         sekvyu/mainwindow.ui
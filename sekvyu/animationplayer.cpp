@@ -0,0 +1,262 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "animationplayer.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QImageReader>
+
+#include "imagescaler.h"
+#include "securearena.h"
+#include "trace.h"
+
+
+
+namespace {
+
+
+constexpr size_t k_maxQueuedFrames = 8;
+constexpr size_t k_maxQueuedBytes = 32 * 1024 * 1024;  // at least one frame is queued whatever its size
+constexpr int k_minDelayMsec = 20;
+constexpr int k_defaultDelayMsec = 100;  // for delays below the minimum, like browsers do
+
+
+size_t GetFrameBytes(const QImage& image)
+{
+	return static_cast<size_t>(image.sizeInBytes());
+}
+
+
+}  // unnamed namespace
+
+
+
+AnimationPlayer::AnimationPlayer(QObject* parent)
+	: QObject(parent)
+	, m_buffer()
+	, m_stillBuffer()
+	, m_worker()
+	, m_stoppedWorkers()
+	, m_timer()
+	, m_currFrame()
+	, m_isStarved(false)
+{
+	m_timer.setSingleShot(true);
+	m_timer.setTimerType(Qt::PreciseTimer);
+	QObject::connect(&m_timer, &QTimer::timeout, this, &AnimationPlayer::presentNext);
+}
+
+AnimationPlayer::~AnimationPlayer()
+{
+	stop();
+	for (auto& worker : m_stoppedWorkers)
+		worker.thread.join();  // they post to this object until they are done
+}
+
+
+// Whether there is more than one frame is found out here from the headers, so that still images,
+// most PNGs and WebPs among them, never get a thread.
+void AnimationPlayer::start(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QSize& targetSize)
+{
+	if (buffer == m_buffer)
+		return;  // already playing
+
+	stop();
+	if (!buffer || !isAnimatedFormat(type))
+		return;
+	if (buffer == m_stillBuffer.lock())
+		return;  // probed before; counting frames may read the whole file, so it is not done twice
+
+	{
+		TRACE_SCOPE("AnimationPlayer::start/probe");
+		auto data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer->GetData()), static_cast<int>(buffer->GetSize()));
+		QBuffer device(&data);
+		device.open(QIODevice::ReadOnly);
+		QImageReader reader(&device, FileFormat::GetQtFormat(type));
+		if (!reader.supportsAnimation() || reader.imageCount() <= 1) {
+			m_stillBuffer = buffer;
+			return;
+		}
+	}
+
+	m_buffer = buffer;
+	m_isStarved = true;  // the first frame is shown as soon as it is decoded
+	auto session = std::make_shared<Session>();
+	session->targetSize = targetSize;
+	m_worker.session = session;
+	m_worker.thread = std::thread( [this, session, buffer, type]() {
+		decodeFrames(session, buffer, type);
+		session->isFinished = true;
+	} );
+}
+
+
+// the worker is told to stop and left to finish its frame by itself
+void AnimationPlayer::stop()
+{
+	if (m_worker.session) {
+		{
+			std::lock_guard<std::mutex> lock(m_worker.session->mutex);
+			m_worker.session->isStopping = true;
+		}
+		m_worker.session->condition.notify_all();
+		m_stoppedWorkers.push_back(std::move(m_worker));
+		m_worker = Worker();
+	}
+	joinFinishedWorkers();
+
+	m_timer.stop();
+	m_buffer.reset();
+	m_currFrame = QImage();
+	m_isStarved = false;
+}
+
+
+void AnimationPlayer::setTargetSize(const QSize& size)
+{
+	if (!m_worker.session)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_worker.session->mutex);
+	m_worker.session->targetSize = size;
+}
+
+
+// Qt's PNG handler ignores APNG chunks, so those only play with a plugin which does not
+bool AnimationPlayer::isAnimatedFormat(FileFormat::Type type)
+{
+	return type == FileFormat::Type::Gif || type == FileFormat::Type::Png || type == FileFormat::Type::WebP;
+}
+
+
+// loops as many times as the image says, then leaves its last frame on screen
+void AnimationPlayer::decodeFrames(const std::shared_ptr<Session>& session, std::shared_ptr<Buffer> buffer, FileFormat::Type type)
+{
+	auto data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer->GetData()), static_cast<int>(buffer->GetSize()));
+	QBuffer device(&data);
+	device.open(QIODevice::ReadOnly);
+	std::unique_ptr<QImageReader> reader(new QImageReader(&device, FileFormat::GetQtFormat(type)));
+
+	const int loopCount = reader->loopCount();  // -1 for forever
+	int numLoops = 0;
+	int numFramesInLoop = 0;
+	for (;;) {
+		QImage image;
+		{
+			TRACE_SCOPE("AnimationPlayer::decodeFrame");
+			if (reader->read(&image)) {
+				QSize targetSize;
+				{
+					std::lock_guard<std::mutex> lock(session->mutex);
+					if (session->isStopping)
+						return;
+					targetSize = session->targetSize;
+				}
+				const auto format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+				image = SecureArena::CopyToArena(ImageScaler::Scale(image.convertToFormat(format), targetSize));
+			}
+		}
+
+		if (image.isNull()) {
+			// end of a loop, or a broken frame which ends it early
+			if (numFramesInLoop == 0 || (loopCount >= 0 && ++numLoops > loopCount))
+				return;
+			numFramesInLoop = 0;
+			device.seek(0);
+			reader.reset(new QImageReader(&device, FileFormat::GetQtFormat(type)));
+			continue;
+		}
+
+		++numFramesInLoop;
+		const int delay = reader->nextImageDelay();
+		if (!pushFrame(session, Frame{ image, delay >= k_minDelayMsec ? delay : k_defaultDelayMsec }))
+			return;
+	}
+}
+
+
+// waits for room in the queue first
+bool AnimationPlayer::pushFrame(const std::shared_ptr<Session>& session, Frame&& frame)
+{
+	{
+		std::unique_lock<std::mutex> lock(session->mutex);
+		session->condition.wait(lock, [&session]() {
+			return session->isStopping || session->frames.empty() ||
+				(session->frames.size() < k_maxQueuedFrames && session->queuedBytes < k_maxQueuedBytes);
+		} );
+		if (session->isStopping)
+			return false;
+
+		session->queuedBytes += GetFrameBytes(frame.image);
+		session->frames.push_back(std::move(frame));
+	}
+
+	QMetaObject::invokeMethod(this, [this, session]() { onFrameDecoded(session); }, Qt::QueuedConnection);
+	return true;
+}
+
+
+// frames of a stopped animation may still arrive
+void AnimationPlayer::onFrameDecoded(const std::shared_ptr<Session>& session)
+{
+	if (session != m_worker.session || !m_isStarved)
+		return;
+
+	m_isStarved = false;
+	presentNext();
+}
+
+
+void AnimationPlayer::presentNext()
+{
+	const auto& session = m_worker.session;
+	if (!session)
+		return;
+
+	Frame frame;
+	{
+		std::lock_guard<std::mutex> lock(session->mutex);
+		if (session->frames.empty()) {
+			m_isStarved = true;  // shown as soon as it is decoded, or never once the animation has ended
+			return;
+		}
+		frame = std::move(session->frames.front());
+		session->frames.pop_front();
+		session->queuedBytes -= GetFrameBytes(frame.image);
+	}
+	session->condition.notify_one();
+
+	m_currFrame = frame.image;
+	m_timer.start(frame.delayMsec);
+	emit frameChanged();
+}
+
+
+void AnimationPlayer::joinFinishedWorkers()
+{
+	for (auto itr = m_stoppedWorkers.begin(); itr != m_stoppedWorkers.end(); ) {
+		if (itr->session->isFinished) {
+			itr->thread.join();  // returns right away
+			itr = m_stoppedWorkers.erase(itr);
+		}
+		else {
+			++itr;
+		}
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANIMATIONPLAYER_H
+#define ANIMATIONPLAYER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QTimer>
+
+// Extract7Z
+#include <Buffer.h>
+
+#include "fileformat.h"
+
+
+
+// Plays one animated image at a time. Frames are decoded and fitted to the target size on a thread
+// of its own, a few frames ahead of presentation, into a queue bounded both in frames and bytes.
+// The GUI thread only takes frames off the queue when their time comes. A stopped worker is left
+// to finish its current frame by itself and joined later, so stopping never waits for a decode.
+// All public methods are meant to be called from the GUI thread.
+class AnimationPlayer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit AnimationPlayer(QObject* parent = nullptr);
+	~AnimationPlayer();
+
+	// images which turn out to have only one frame are never played
+	void start(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QSize& targetSize);
+	void stop();
+	void setTargetSize(const QSize& size);  // for frames decoded from now on
+
+	inline const QImage& getCurrentFrame() const	{ return m_currFrame; }  // null until the first one is due
+
+	static bool isAnimatedFormat(FileFormat::Type type);
+
+
+signals:
+	void frameChanged();
+
+
+private:
+	struct Frame
+	{
+		QImage image;
+		int delayMsec;
+	};
+
+	// what the GUI thread shares with one worker, from start() until the worker is joined
+	struct Session
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<Frame> frames;
+		size_t queuedBytes = 0;
+		QSize targetSize;
+		bool isStopping = false;
+		std::atomic<bool> isFinished{ false };
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		std::shared_ptr<Session> session;
+	};
+
+	void decodeFrames(const std::shared_ptr<Session>& session, std::shared_ptr<Buffer> buffer, FileFormat::Type type);  // on the worker
+	bool pushFrame(const std::shared_ptr<Session>& session, Frame&& frame);  // false once stopped
+	void onFrameDecoded(const std::shared_ptr<Session>& session);
+	void presentNext();
+	void joinFinishedWorkers();
+
+
+	std::shared_ptr<Buffer> m_buffer;
+	std::weak_ptr<Buffer> m_stillBuffer;  // last one probed and found to have a single frame
+	Worker m_worker;  // of the animation playing, if any
+	std::list<Worker> m_stoppedWorkers;  // still finishing their last frame
+	QTimer m_timer;
+	QImage m_currFrame;
+	bool m_isStarved;  // the next frame was due before it was decoded
+};
+
+
+
+#endif // ANIMATIONPLAYER_H
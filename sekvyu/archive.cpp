@@ -20,29 +20,90 @@
 
 #include "archive.h"
 
-#include <windows.h>
-
+#include <QFile>
 #include <QFileInfo>
 
 #include <Extractor7Z.h>
 #include <Buffer.h>
+#include <Password.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif  // _WIN32
+
+#include "securearena.h"
+#include "trace.h"
 
 
 
 namespace {
 
 
-bool SetWorkingSetSizeHint(size_t sizeHint)
+constexpr size_t k_workingSetReserve = 1024 * 1024 * 100;  // for all other things in the process
+constexpr qint64 k_maxReadAhead = 256 * 1024 * 1024;  // beyond this the OS's own read-ahead has caught up
+
+
+// Maps the start of the archive read-only and asks the OS to read it in ahead of Extractor7Z, whose
+// own reads are then served from the page cache instead of waiting on the disk chunk by chunk.
+// Only the first k_maxReadAhead bytes are hinted, so a multi-GB archive is not pushed into the page
+// cache all at once next to the working set sized for its extracted data. Unmapped when it goes
+// out of scope; failing to map only means no read-ahead. SEKVYU_NO_READ_AHEAD turns it off for
+// benchmarking.
+class ReadAheadHint
 {
-	HANDLE hProc = GetCurrentProcess();
-	size_t minSize, maxSize;
-	GetProcessWorkingSetSize(hProc, &minSize, &maxSize);
-
-	if (minSize < sizeHint)
-		return SetProcessWorkingSetSize(hProc, sizeHint, std::max(sizeHint, maxSize)) != FALSE;
-	else
-		return true;  // no need to expand
-}
+public:
+	explicit ReadAheadHint(const QString& path)
+		: m_file(path)
+		, m_data(nullptr)
+	{
+		// 32-bit address space is too tight to hold a mapping next to the extracted data
+		if (sizeof(void*) < 8 || qEnvironmentVariableIsSet("SEKVYU_NO_READ_AHEAD") || !m_file.open(QIODevice::ReadOnly) || m_file.size() == 0)
+			return;
+		const qint64 size = std::min(m_file.size(), k_maxReadAhead);
+		m_data = m_file.map(0, size);
+		if (m_data != nullptr)
+			Advise(m_data, static_cast<size_t>(size));
+	}
+
+	~ReadAheadHint()
+	{
+		if (m_data != nullptr)
+			m_file.unmap(m_data);
+	}
+
+	ReadAheadHint(const ReadAheadHint&) = delete;
+	ReadAheadHint& operator=(const ReadAheadHint&) = delete;
+
+
+private:
+	static void Advise(uchar* data, size_t size)
+	{
+#ifdef _WIN32
+		// PrefetchVirtualMemory() only exists since Windows 8
+		struct MemoryRange
+		{
+			void* virtualAddress;
+			size_t numberOfBytes;
+		};
+		using PrefetchFunc = BOOL (WINAPI*)(HANDLE, ULONG_PTR, MemoryRange*, ULONG);
+
+		static const auto prefetch = reinterpret_cast<PrefetchFunc>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+		if (prefetch != nullptr) {
+			MemoryRange range = { data, size };
+			prefetch(GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		madvise(data, size, MADV_SEQUENTIAL);
+		madvise(data, size, MADV_WILLNEED);
+#endif  // _WIN32
+	}
+
+
+	QFile m_file;
+	uchar* m_data;
+};
 
 
 }  // unnamed namespace
@@ -53,46 +114,118 @@ Archive::Archive()
 	: m_name()
 	, m_path()
 	, m_content(new FileArchive)  // always allocate an empty one
+	, m_types()
 	, m_lastSavedDir()
 {
 }
 
 
-Archive::OpenResult Archive::Open(const QString& path, Password& password)
+Archive::OpenResult Archive::Open(const QString& path, const PasswordCallback& getPassword, const EntryFilter& filter)
 {
+	TRACE_SCOPE("Archive::Open");
+
 	if (path == m_path)
 		return OpenResult::Success;
 	else if (!Extractor7Z::CheckLibrary())
 		return OpenResult::DllNotFound;
 
-	auto filePath = reinterpret_cast<const wchar_t*>(path.utf16());
-	size_t uncompressedSize;
-	Extractor7Z::GetUncompressedSize(filePath, &password, uncompressedSize);
-	SetWorkingSetSizeHint(uncompressedSize + 1024 * 1024 * 100);  // +100MB for all other things in the process
+	// Images hardly compress any further, so the size of the archive itself is a close estimate
+	// of what will be extracted. Asking Extractor7Z::GetUncompressedSize instead would open and
+	// parse the archive a second time, including another key derivation and header decryption
+	// for archives with encrypted headers.
+	const auto& fileInfo = QFileInfo(path);
+	const auto archiveSize = static_cast<size_t>(fileInfo.size());
+	SecureArena::SetWorkingSetSizeHint(archiveSize + archiveSize / 8 + k_workingSetReserve);
+
+	bool isPasswordAsked = false;
+	Password password( [&getPassword, &isPasswordAsked](std::wstring& outPasswd) -> bool {
+		isPasswordAsked = true;
+		if (getPassword)
+			return getPassword(outPasswd);
+		outPasswd.clear();
+		return true;  // never ask again
+	} );
 
+	ReadAheadHint readAhead(path);
+
+	const auto& filePath = path.toStdWString();  // wchar_t is 32-bit outside Windows
 	Extractor7Z::ExtractOptions options;
 	options.passwd = &password;
 	options.isSecrecy = true;
-	auto newArchive = Extractor7Z::ExtractFrom(filePath, options);
-	if (!newArchive)
-		return OpenResult::ExtractionError;
+	std::shared_ptr<FileArchive> newArchive;
+	{
+		TRACE_SCOPE("Extractor7Z::ExtractFrom");
+		newArchive = Extractor7Z::ExtractFrom(filePath.c_str(), options);
+	}
+	if (!newArchive) {
+		// Extractor7Z gives no reason. Once a password has been given, a failure is a wrong password
+		// but for damaged archives, which 7-Zip cannot tell apart from it either.
+		return isPasswordAsked ? OpenResult::WrongPassword : OpenResult::ExtractionError;
+	}
+
+	// Extractor7Z hands back every entry at once, so this is the earliest point where rejected ones
+	// can be dropped. Doing it before anything else sees the archive keeps them from being counted
+	// in the working set below.
+	std::vector<FileFormat::Type> types;
+	{
+		TRACE_SCOPE("Archive::Open/filter");
+		types.resize(newArchive->size());
+		std::transform(newArchive->cbegin(), newArchive->cend(), types.begin(), [](const FileRecord& frec) {
+			return frec.data ? FileFormat::GetType(frec.data->GetData(), frec.data->GetSize()) : FileFormat::Type::Unknown;
+		} );
+		if (filter)
+			FilterEntries(*newArchive, types, filter);
+	}
+
+	// in case the estimate was short
+	size_t extractedSize = 0;
+	for (const auto& fileRecord : *newArchive)
+		extractedSize += fileRecord.data ? fileRecord.data->GetSize() : 0;
+	SecureArena::SetWorkingSetSizeHint(extractedSize + k_workingSetReserve);
 
-	const auto& fileInfo = QFileInfo(path);
 	m_name = fileInfo.fileName();
 	m_path = path;
 	m_content = newArchive;
+	m_types = std::move(types);
 	m_lastSavedDir = fileInfo.absolutePath() + "/";
 
 	return OpenResult::Success;
 }
 
 
+void Archive::Filter(const EntryFilter& func)
+{
+	TRACE_SCOPE("Archive::Filter");
+	FilterEntries(*m_content, m_types, func);
+}
+
+
+// in place, so that rejected entries are released without copying the kept ones
+void Archive::FilterEntries(FileArchive& content, std::vector<FileFormat::Type>& types, const EntryFilter& func)
+{
+	size_t numKept = 0;
+	for (size_t i = 0; i < content.size(); ++i) {
+		if (!func(content[i], types[i]))
+			continue;
+		if (numKept != i) {
+			content[numKept] = std::move(content[i]);
+			types[numKept] = types[i];
+		}
+		++numKept;
+	}
+	content.erase(content.begin() + numKept, content.end());
+	types.resize(numKept);
+}
+
+
 bool Archive::Save(size_t index, const QString& path)
 {
-	if (index >= m_content->size())
+	TRACE_SCOPE("Archive::Save");
+
+	const auto& fileBuffer = GetFileData(index);
+	if (!fileBuffer)
 		return false;
 
-	const auto& fileBuffer = m_content->at(index).data;
 	QFile ourFile(path);
 	if (!ourFile.open(QIODevice::WriteOnly))
 		return false;
@@ -104,6 +237,30 @@ bool Archive::Save(size_t index, const QString& path)
 }
 
 
+// All per-entry access from the viewer goes through here rather than through GetContent(), so that
+// where and when an entry's bytes become available stays an implementation detail of Archive.
+std::shared_ptr<Buffer> Archive::GetFileData(size_t index) const
+{
+	if (index >= m_content->size())
+		return nullptr;
+	return m_content->at(index).data;
+}
+
+FileFormat::Type Archive::GetFileType(size_t index) const
+{
+	if (index >= m_types.size())
+		return FileFormat::Type::Unknown;
+	return m_types[index];
+}
+
+QString Archive::GetFileName(size_t index) const
+{
+	if (index >= m_content->size())
+		return QString();
+	return QString::fromStdWString(m_content->at(index).name);
+}
+
+
 QString Archive::GetName() const
 {
 	return m_name;
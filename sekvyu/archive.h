@@ -20,13 +20,17 @@
 #define ARCHIVE_H
 
 #include <algorithm>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <QString>
 
 // Extract7Z
 #include <BufferedFile.h>
-#include <Password.h>
+
+#include "fileformat.h"
 
 
 
@@ -37,38 +41,44 @@ public:
 	{
 		Success,
 		DllNotFound,
+		WrongPassword,
 		ExtractionError
 	};
 
 
+	// same contract as the callback of Extract7Z's Password
+	using PasswordCallback = std::function<bool(std::wstring&)>;
+
+	// Entries for which it returns false are dropped as soon as extraction is done. Each entry comes
+	// with its sniffed type, which is kept for the ones which stay.
+	using EntryFilter = std::function<bool(const FileRecord&, FileFormat::Type)>;
+
+
 	Archive();
 
-	OpenResult Open(const QString& path, Password& password);
+	OpenResult Open(const QString& path, const PasswordCallback& getPassword, const EntryFilter& filter = EntryFilter());
 	bool Save(size_t index, const QString& path);
 
-	inline FileArchive& GetContent()		{ return const_cast<FileArchive&>(reinterpret_cast<const Archive*>(this)->GetContent()); }
-	const FileArchive& GetContent() const   { return *m_content; }
+	const FileArchive& GetContent() const   { return *m_content; }  // entries only change through Filter, which keeps types in step
 	inline size_t GetFileCount() const	  { return m_content->size(); }
+	std::shared_ptr<Buffer> GetFileData(size_t index) const;
+	FileFormat::Type GetFileType(size_t index) const;
+	QString GetFileName(size_t index) const;
 	QString GetName() const;
 	QString GetPath() const;
 	QString GetLastSavedDir() const;
 
-	template <typename FuncType>
-	void Filter(const FuncType& func)
-	{
-		if (m_content->size() == 0)
-			return;
-
-		FileArchive filteredFiles;
-		std::copy_if(m_content->cbegin(), m_content->cend(), std::back_inserter(filteredFiles), func);
-		*m_content = std::move(filteredFiles);
-	}
+	void Filter(const EntryFilter& func);
 
 
 private:
+	static void FilterEntries(FileArchive& content, std::vector<FileFormat::Type>& types, const EntryFilter& func);
+
+
 	QString m_name;
 	QString m_path;
 	std::shared_ptr<FileArchive> m_content;
+	std::vector<FileFormat::Type> m_types;  // of entries in m_content, sniffed once when opened
 	QString m_lastSavedDir;
 };
 
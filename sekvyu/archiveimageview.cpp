@@ -18,8 +18,49 @@
 
 #include "archiveimageview.h"
 
-// Extract7Z
-#include <Buffer.h>
+#include <algorithm>
+#include <cmath>
+
+#include <QApplication>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QSignalBlocker>
+#include <QWheelEvent>
+
+#include "trace.h"
+
+
+
+namespace {
+
+
+constexpr int k_resizeIdleMsec = 150;  // before the high-quality rescale after resizing stops
+constexpr int k_settleMsec = 200;  // navigation closer together than this is scrubbing, e.g. a held key
+constexpr double k_zoomStep = 1.25;
+constexpr double k_maxZoom = 4.0;  // view pixels per image pixel
+constexpr int k_stripLineStep = 20;  // pixels per scrolled line, as in Qt's scroll areas
+
+
+
+// facing pages meet in the middle, each centred vertically
+QPixmap ComposeSpread(const QImage& left, const QImage& right)
+{
+	const QSize size(left.width() + right.width(), std::max(left.height(), right.height()));
+	if (size.isEmpty())
+		return QPixmap();
+
+	QPixmap spread(size);
+	spread.fill(Qt::transparent);
+	QPainter painter(&spread);
+	if (!left.isNull())
+		painter.drawImage(0, (size.height() - left.height()) / 2, left);
+	if (!right.isNull())
+		painter.drawImage(left.width(), (size.height() - right.height()) / 2, right);
+	return spread;
+}
+
+
+}  // unnamed namespace
 
 
 
@@ -27,9 +68,44 @@ ArchiveImageView::ArchiveImageView(QWidget *parent)
 	: QLabel(parent)
 	, m_archive()
 	, m_index(0)
-	, m_currPixmap()
+	, m_isForward(true)
+	, m_viewMode(ViewMode::SinglePage)
+	, m_isRightToLeft(false)
+	, m_hasCoverPage(false)
+	, m_currImage()
+	, m_fullSize()
+	, m_frame()
+	, m_spreadPages()
+	, m_zoom(0.0)
+	, m_focus()
+	, m_dragPos()
+	, m_stripLayout()
+	, m_stripOffset(0.0)
+	, m_scrollBar(new QScrollBar(Qt::Vertical, this))
+	, m_imageCache()
+	, m_tileCache()
+	, m_animation()
+	, m_resizeTimer()
+	, m_settleTimer()
 {
+	m_resizeTimer.setSingleShot(true);
+	m_resizeTimer.setInterval(k_resizeIdleMsec);
+	m_settleTimer.setSingleShot(true);
+	m_settleTimer.setInterval(k_settleMsec);
+	m_scrollBar->setSingleStep(k_stripLineStep);
+	m_scrollBar->hide();
 
+	QObject::connect(&m_imageCache, &ImageCache::imageReady, this, &ArchiveImageView::onImageReady);
+	QObject::connect(&m_tileCache, &TileCache::tileReady, this, static_cast<void (QWidget::*)()>(&QWidget::update));
+	QObject::connect(&m_animation, &AnimationPlayer::frameChanged, this, static_cast<void (QWidget::*)()>(&QWidget::update));
+	QObject::connect(&m_resizeTimer, &QTimer::timeout, this, &ArchiveImageView::onResizeIdle);
+	QObject::connect(&m_settleTimer, &QTimer::timeout, this, [this]() {
+		if (m_viewMode != ViewMode::SinglePage || !m_archive)
+			return;
+		loadCurrPixmapFromArchive();  // shows whatever is cached, which may only be a preview
+		m_imageCache.request(m_index);  // so the full decode is asked for explicitly
+	} );
+	QObject::connect(m_scrollBar, &QScrollBar::valueChanged, this, [this](int value) { scrollStripTo(value); } );
 }
 
 
@@ -38,21 +114,53 @@ bool ArchiveImageView::setArchive(std::shared_ptr<Archive>& archive)
 	if (!archive || archive->GetFileCount() == 0)
 		return false;
 
+	m_animation.stop();
 	m_archive = archive;
 	m_index = 0;
-	loadCurrPixmapFromArchive();
-	refreshView();
+	m_isForward = true;
+	m_currImage = QImage();
+	m_frame = QPixmap();
+	m_spreadPages = {};
+	m_zoom = 0.0;
+	m_stripLayout.Reset(archive->GetFileCount());
+	m_stripOffset = 0.0;
+	m_imageCache.setArchive(archive);
+	m_imageCache.setTargetSize(getTargetSize());
+	m_tileCache.setArchive(archive);
+	if (m_viewMode == ViewMode::ContinuousScroll)
+		updateStripLayout();
+	else
+		loadCurrPixmapFromArchive();
+	emit indexChanged(m_index);
 
 	return true;
 }
 
 
+// shows a message in place of the image until the next decoded one arrives
+void ArchiveImageView::setPending(const QString& msg)
+{
+	m_currImage = QImage();
+	m_frame = QPixmap();
+	setText(msg);
+}
+
+
 void ArchiveImageView::rotate(Rotation target)
 {
 	size_t fileCount;
 	if (!m_archive || (fileCount = m_archive->GetFileCount()) == 0)
 		return;
+	if (m_viewMode == ViewMode::ContinuousScroll) {
+		rotateStrip(target);
+		return;
+	}
+	else if (m_viewMode == ViewMode::TwoPageSpread) {
+		rotateSpread(target);
+		return;
+	}
 
+	m_isForward = target == Rotation::Next || target == Rotation::First;
 	if (target == Rotation::Previous && m_index > 0)
 		--m_index;
 	else if (target == Rotation::Next && m_index < fileCount - 1)
@@ -64,8 +172,9 @@ void ArchiveImageView::rotate(Rotation target)
 	else
 		return;
 
-	loadCurrPixmapFromArchive();
-	refreshView();
+	m_zoom = 0.0;
+	navigate();
+	emit indexChanged(m_index);
 }
 
 
@@ -80,34 +189,630 @@ void ArchiveImageView::setIndex(size_t index)
 	;
 	if (shouldSkip)
 		return;
+	if (m_viewMode == ViewMode::ContinuousScroll) {
+		scrollStripTo(m_stripLayout.GetPageTop(index));
+		return;
+	}
+	else if (m_viewMode == ViewMode::TwoPageSpread && (index = getSpreadFirst(index)) == m_index) {
+		return;
+	}
 
+	m_isForward = index > m_index;
 	m_index = index;
-	loadCurrPixmapFromArchive();
-	refreshView();
+	m_zoom = 0.0;
+	navigate();
+	emit indexChanged(m_index);
 }
 
 
 void ArchiveImageView::loadCurrPixmapFromArchive()
 {
+	TRACE_SCOPE("ArchiveImageView::loadCurrPixmapFromArchive");
 	if (!m_archive || m_archive->GetFileCount() == 0)
 		return;
+	if (m_viewMode == ViewMode::TwoPageSpread) {
+		loadCurrSpreadFromArchive();
+		return;
+	}
+
+	QImage image;
+	if (m_imageCache.lookup(m_index, image)) {
+		m_currImage = image;
+		m_fullSize = m_imageCache.getFullSize(m_index);
+		if (m_currImage.isNull()) {
+			m_animation.stop();
+			setText("Failed to decode the image.");
+		}
+		else {
+			m_tileCache.setPage(m_index, m_fullSize);
+			refreshView();
+			m_animation.start(m_archive->GetFileData(m_index), m_archive->GetFileType(m_index), size());  // drawn over the still frame once decoded
+		}
+	}
+	else {
+		m_animation.stop();
+		// the previous image stays on screen until this one is ready
+		if (m_currImage.isNull())
+			setText("Loading...");
+		m_imageCache.request(m_index);
+	}
+
+	m_imageCache.prefetch(m_index, m_isForward);
+}
+
+
+// The first step is loaded as usual. Steps following it quickly only get previews, and everything
+// in flight for the pages passed on the way is abandoned, until navigation settles.
+void ArchiveImageView::navigate()
+{
+	const bool isScrubbing = m_settleTimer.isActive();
+	m_settleTimer.start();
+	if (isScrubbing && m_viewMode == ViewMode::SinglePage)
+		showPreview();
+	else
+		loadCurrPixmapFromArchive();
+}
+
+
+// whatever is cached of the current page, or else the previous page until its preview is decoded
+void ArchiveImageView::showPreview()
+{
+	TRACE_SCOPE("ArchiveImageView::showPreview");
+	m_animation.stop();
+
+	QImage image;
+	if (m_imageCache.lookup(m_index, image) && !image.isNull()) {
+		m_currImage = image;
+		m_fullSize = m_imageCache.getFullSize(m_index);
+		refreshView();
+	}
+	m_imageCache.requestPreview(m_index);
+}
+
+
+// sizes are collected in either mode so that the strip has them when it is switched to
+void ArchiveImageView::onImageReady(size_t index)
+{
+	const bool isStripChanged = m_stripLayout.SetPageSize(index, m_imageCache.getFullSize(index));
+	if (m_viewMode == ViewMode::ContinuousScroll) {
+		if (isStripChanged)
+			updateStripLayout();
+		else
+			update();
+	}
+	else if (m_settleTimer.isActive() && m_viewMode == ViewMode::SinglePage) {
+		if (index == m_index)
+			showPreview();
+	}
+	else if (index == m_index || (m_viewMode == ViewMode::TwoPageSpread && index == getSpreadLast(m_index))) {
+		loadCurrPixmapFromArchive();
+	}
+}
+
+
+void ArchiveImageView::onResizeIdle()
+{
+	m_imageCache.setTargetSize(getTargetSize());  // rescales the current page and its neighbours in background
+	if (m_viewMode == ViewMode::ContinuousScroll)
+		requestStripPages();
+	else if (m_viewMode == ViewMode::TwoPageSpread)
+		m_imageCache.requestRange(m_index, getSpreadLast(m_index), m_isForward);
+	else
+		m_imageCache.request(m_index);
+}
+
+
+void ArchiveImageView::setViewMode(ViewMode mode)
+{
+	if (mode == m_viewMode)
+		return;
+
+	m_viewMode = mode;
+	m_animation.stop();
+	m_zoom = 0.0;
+	m_stripOffset = 0.0;  // the current page goes to the top
+	unsetCursor();
+	m_scrollBar->setVisible(mode == ViewMode::ContinuousScroll);
+	m_imageCache.setTargetSize(getTargetSize());
+
+	if (mode == ViewMode::ContinuousScroll) {
+		updateStripLayout();
+	}
+	else if (m_archive) {
+		const size_t oldIndex = m_index;
+		if (mode == ViewMode::TwoPageSpread)
+			m_index = getSpreadFirst(m_index);
+		m_currImage = QImage();
+		m_frame = QPixmap();
+		loadCurrPixmapFromArchive();
+		if (m_index != oldIndex)
+			emit indexChanged(m_index);
+	}
+	update();
+}
+
+
+// the spread on screen stays until the one it changes to is ready
+void ArchiveImageView::setSpreadOptions(bool isRightToLeft, bool hasCoverPage)
+{
+	if (isRightToLeft == m_isRightToLeft && hasCoverPage == m_hasCoverPage)
+		return;
+
+	m_isRightToLeft = isRightToLeft;
+	m_hasCoverPage = hasCoverPage;
+	if (m_viewMode != ViewMode::TwoPageSpread || !m_archive)
+		return;
+
+	const size_t oldIndex = m_index;
+	m_index = getSpreadFirst(m_index);
+	loadCurrPixmapFromArchive();
+	if (m_index != oldIndex)
+		emit indexChanged(m_index);
+}
+
+
+void ArchiveImageView::zoomIn()
+{
+	setZoom((isZoomed() ? m_zoom : getFitScale()) * k_zoomStep, QPointF(width() / 2.0, height() / 2.0));
+}
+
+
+void ArchiveImageView::zoomOut()
+{
+	setZoom((isZoomed() ? m_zoom : getFitScale()) / k_zoomStep, QPointF(width() / 2.0, height() / 2.0));
+}
+
+
+void ArchiveImageView::zoomToFit()
+{
+	if (!isZoomed())
+		return;
 
-	auto imgData = m_archive->GetContent().at(m_index).data;
-	m_currPixmap.loadFromData( imgData->GetData(), static_cast<uint>(imgData->GetSize()) );
+	m_zoom = 0.0;
+	unsetCursor();
+	refreshView();
 }
 
 
 void ArchiveImageView::refreshView()
 {
-	if (m_currPixmap.isNull())
+	TRACE_SCOPE("ArchiveImageView::refreshView");
+	if (m_currImage.isNull())
+		return;
+
+	if (isZoomed()) {
+		clampFocus();
+		update();
+		return;
+	}
+
+	QImage scaled;
+	if (m_imageCache.getTargetSize() == getTargetSize() && m_imageCache.lookupScaled(m_index, scaled)) {
+		m_frame = QPixmap::fromImage(scaled);
+		update();
+		emit pageShown(m_index);
+		return;
+	}
+
+	// cheap nearest-neighbour frame until the high-quality one is ready
+	m_frame = QPixmap::fromImage(m_currImage.scaled(size(), Qt::KeepAspectRatio, Qt::FastTransformation));  // fit to current size
+	update();
+	m_resizeTimer.start();
+}
+
+
+// pages are scaled to the width of the column in continuous scroll, whatever their height
+QSize ArchiveImageView::getTargetSize() const
+{
+	if (m_viewMode == ViewMode::ContinuousScroll)
+		return QSize(getStripColumnWidth(), QWIDGETSIZE_MAX);
+	else if (m_viewMode == ViewMode::TwoPageSpread)
+		return QSize(std::max(width() / 2, 1), height());
+	return size();
+}
+
+
+size_t ArchiveImageView::getSpreadFirst(size_t index) const
+{
+	if (m_hasCoverPage)
+		return index == 0 ? 0 : index - (index - 1) % 2;
+	return index - index % 2;
+}
+
+
+size_t ArchiveImageView::getSpreadLast(size_t first) const
+{
+	if (m_hasCoverPage && first == 0)
+		return 0;
+	return std::min(first + 1, m_archive->GetFileCount() - 1);
+}
+
+
+void ArchiveImageView::rotateSpread(Rotation target)
+{
+	const size_t lastIndex = m_archive->GetFileCount() - 1;
+	size_t first = m_index;
+	if (target == Rotation::First)
+		first = 0;
+	else if (target == Rotation::Last)
+		first = getSpreadFirst(lastIndex);
+	else if (target == Rotation::Previous && m_index > 0)
+		first = getSpreadFirst(m_index - 1);
+	else if (target == Rotation::Next && getSpreadLast(m_index) < lastIndex)
+		first = getSpreadLast(m_index) + 1;
+
+	if (first == m_index)
+		return;
+
+	m_isForward = first > m_index;
+	m_index = first;
+	loadCurrSpreadFromArchive();
+	emit indexChanged(m_index);
+}
+
+
+// Both pages are requested at once, so they are decoded and scaled on two workers in parallel, and
+// the next spread is prefetched after them. Nothing is shown until both are there.
+void ArchiveImageView::loadCurrSpreadFromArchive()
+{
+	TRACE_SCOPE("ArchiveImageView::loadCurrSpreadFromArchive");
+	const size_t last = getSpreadLast(m_index);
+	std::array<QImage, 2> pages;
+	if (m_imageCache.lookup(m_index, pages[0]) && m_imageCache.lookup(last, pages[1])) {
+		m_spreadPages = pages;
+		if (pages[0].isNull() && pages[1].isNull()) {
+			m_frame = QPixmap();
+			setText("Failed to decode the image.");
+		}
+		else {
+			refreshSpread();
+		}
+	}
+	else if (m_frame.isNull()) {
+		setText("Loading...");  // otherwise the previous spread stays on screen until this one is ready
+	}
+
+	m_imageCache.requestRange(m_index, last, m_isForward);
+}
+
+
+void ArchiveImageView::refreshSpread()
+{
+	TRACE_SCOPE("ArchiveImageView::refreshSpread");
+	const size_t numPages = getSpreadLast(m_index) - m_index + 1;
+	const bool isTargetCurrent = m_imageCache.getTargetSize() == getTargetSize();
+	std::array<QImage, 2> frames;
+	bool isFinal = true;
+	for (size_t i = 0; i < numPages; ++i) {
+		if (m_spreadPages[i].isNull())
+			continue;
+		if (!isTargetCurrent || !m_imageCache.lookupScaled(m_index + i, frames[i])) {
+			// cheap nearest-neighbour frame until the high-quality one is ready
+			frames[i] = m_spreadPages[i].scaled(getTargetSize(), Qt::KeepAspectRatio, Qt::FastTransformation);
+			isFinal = false;
+		}
+	}
+
+	m_frame = m_isRightToLeft ? ComposeSpread(frames[1], frames[0]) : ComposeSpread(frames[0], frames[1]);
+	update();
+	if (isFinal)
+		emit pageShown(m_index);
+	else
+		m_resizeTimer.start();
+}
+
+
+double ArchiveImageView::getFitScale() const
+{
+	if (m_fullSize.isEmpty())
+		return 1.0;
+	return std::min(static_cast<double>(width()) / m_fullSize.width(), static_cast<double>(height()) / m_fullSize.height());
+}
+
+
+// anything at or below the fitting scale goes back to fitting the view
+void ArchiveImageView::setZoom(double zoom, const QPointF& anchor)
+{
+	if (m_viewMode != ViewMode::SinglePage || m_currImage.isNull() || m_fullSize.isEmpty())
+		return;
+
+	const double fitScale = getFitScale();
+	if (zoom <= fitScale) {
+		zoomToFit();
+		return;
+	}
+
+	const double oldZoom = isZoomed() ? m_zoom : fitScale;
+	if (!isZoomed())
+		m_focus = QPointF(m_fullSize.width() / 2.0, m_fullSize.height() / 2.0);
+
+	zoom = std::min(zoom, std::max(k_maxZoom, fitScale));
+	const QPointF offset = anchor - QPointF(width() / 2.0, height() / 2.0);
+	m_focus += offset / oldZoom - offset / zoom;
+	m_zoom = zoom;
+	clampFocus();
+	update();
+}
+
+
+// keeps the view covered by the image, or the image centred along axes where it is smaller than the view
+void ArchiveImageView::clampFocus()
+{
+	auto clamp = [](double focus, double viewExtent, double imageExtent) {
+		const double halfView = viewExtent / 2.0;
+		if (imageExtent <= 2.0 * halfView)
+			return imageExtent / 2.0;
+		return std::min(std::max(focus, halfView), imageExtent - halfView);
+	};
+
+	m_focus.setX(clamp(m_focus.x(), width() / m_zoom, m_fullSize.width()));
+	m_focus.setY(clamp(m_focus.y(), height() / m_zoom, m_fullSize.height()));
+}
+
+
+// the decoded image stretched as a base layer, with sharper tiles drawn over it as they arrive
+void ArchiveImageView::paintZoomed(QPainter& painter)
+{
+	TRACE_SCOPE("ArchiveImageView::paintZoomed");
+	const QPointF origin = QPointF(width() / 2.0, height() / 2.0) - m_focus * m_zoom;  // where image point (0, 0) is
+	const QRectF visible = QRectF(origin, QSizeF(m_fullSize) * m_zoom) & QRectF(rect());
+	if (visible.isEmpty())
+		return;
+
+	const QRectF visibleInImage((visible.topLeft() - origin) / m_zoom, visible.size() / m_zoom);
+	const double baseScale = static_cast<double>(m_currImage.width()) / m_fullSize.width();
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+	painter.drawImage(visible, m_currImage, QRectF(visibleInImage.topLeft() * baseScale, visibleInImage.size() * baseScale));
+
+	if (baseScale >= m_zoom || !m_tileCache.setPage(m_index, m_fullSize))
+		return;  // already as sharp as it gets
+
+	const int level = TileCache::getLevelForScale(m_zoom, m_fullSize);
+	const double span = static_cast<double>(TileCache::getTileSize() << level);
+	const QRect tiles(
+		QPoint(static_cast<int>(visibleInImage.left() / span), static_cast<int>(visibleInImage.top() / span)),
+		QPoint(static_cast<int>(std::ceil(visibleInImage.right() / span)) - 1, static_cast<int>(std::ceil(visibleInImage.bottom() / span)) - 1)
+	);
+	m_tileCache.setVisibleTiles(level, tiles);
+
+	bool isAnyMissing = false;
+	for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+		for (int column = tiles.left(); column <= tiles.right(); ++column) {
+			QImage tile;
+			if (!m_tileCache.lookup(level, column, row, tile)) {
+				isAnyMissing = true;
+				continue;
+			}
+			if (tile.isNull())
+				continue;  // the base layer stays
+
+			const QRect& tileRect = TileCache::getTileRect(level, column, row, m_fullSize);
+			painter.drawImage(QRectF(origin + QPointF(tileRect.topLeft()) * m_zoom, QSizeF(tileRect.size()) * m_zoom), tile);
+		}
+	}
+	if (isAnyMissing)
+		m_tileCache.request(level, tiles);
+}
+
+
+int ArchiveImageView::getStripColumnWidth() const
+{
+	return std::max(width() - m_scrollBar->sizeHint().width(), 1);
+}
+
+
+double ArchiveImageView::getStripPosition() const
+{
+	return m_stripLayout.GetPageTop(m_index) + m_stripOffset * m_stripLayout.GetPageHeight(m_index);
+}
+
+
+// The position is kept relative to the page at the top, so pages above it which turn out to be
+// taller or shorter than estimated do not move what is on screen.
+void ArchiveImageView::scrollStripTo(double y)
+{
+	if (!m_archive || m_stripLayout.GetPageCount() == 0)
+		return;
+
+	y = std::min(std::max(y, 0.0), static_cast<double>(m_scrollBar->maximum()));
+	const double oldY = getStripPosition();
+	if (y != oldY)
+		m_isForward = y > oldY;
+
+	const size_t oldIndex = m_index;
+	m_index = m_stripLayout.GetPageAt(y);
+	const double pageHeight = m_stripLayout.GetPageHeight(m_index);
+	m_stripOffset = pageHeight > 0.0 ? (y - m_stripLayout.GetPageTop(m_index)) / pageHeight : 0.0;
+
+	{
+		const QSignalBlocker blocker(m_scrollBar);
+		m_scrollBar->setValue(static_cast<int>(std::lround(y)));
+	}
+	requestStripPages();
+	update();
+
+	if (m_index != oldIndex)
+		emit indexChanged(m_index);
+}
+
+
+// a screen at a time, since a single strip can be many screens tall, keeping a line of the last one in view
+void ArchiveImageView::rotateStrip(Rotation target)
+{
+	const double screen = std::max(height() - k_stripLineStep, k_stripLineStep);
+	if (target == Rotation::First)
+		scrollStripTo(0.0);
+	else if (target == Rotation::Last)
+		scrollStripTo(m_scrollBar->maximum());
+	else if (target == Rotation::Previous)
+		scrollStripTo(getStripPosition() - screen);
+	else
+		scrollStripTo(getStripPosition() + screen);
+}
+
+
+void ArchiveImageView::updateStripLayout()
+{
+	const int scrollBarWidth = m_scrollBar->sizeHint().width();
+	m_scrollBar->setGeometry(width() - scrollBarWidth, 0, scrollBarWidth, height());
+	m_stripLayout.SetColumnWidth(getStripColumnWidth());
+
+	{
+		const QSignalBlocker blocker(m_scrollBar);
+		m_scrollBar->setRange(0, static_cast<int>(std::ceil(std::max(m_stripLayout.GetTotalHeight() - height(), 0.0))));
+		m_scrollBar->setPageStep(height());
+	}
+	scrollStripTo(getStripPosition());
+}
+
+
+void ArchiveImageView::requestStripPages()
+{
+	const size_t lastShown = m_stripLayout.GetPageAt(getStripPosition() + height() - 1);
+	m_imageCache.requestRange(m_index, lastShown, m_isForward);
+}
+
+
+// Only pages on screen are drawn. Until the frame scaled to the column is ready, a page is stretched
+// from whatever resolution it has been decoded at, and pages not decoded yet are left blank.
+void ArchiveImageView::paintStrip(QPainter& painter)
+{
+	TRACE_SCOPE("ArchiveImageView::paintStrip");
+	const double viewTop = getStripPosition();
+	const int columnWidth = m_stripLayout.GetColumnWidth();
+	for (size_t index = m_index; index < m_stripLayout.GetPageCount(); ++index) {
+		const double pageTop = m_stripLayout.GetPageTop(index) - viewTop;
+		if (pageTop >= height())
+			break;
+
+		QImage image;
+		if (m_imageCache.lookupScaled(index, image) && image.width() == columnWidth)
+			painter.drawImage(QPoint(0, static_cast<int>(std::lround(pageTop))), image);
+		else if (m_imageCache.lookup(index, image) && !image.isNull())
+			painter.drawImage(QRectF(0.0, pageTop, columnWidth, m_stripLayout.GetPageHeight(index)), image);
+	}
+}
+
+
+void ArchiveImageView::paintEvent(QPaintEvent* event)
+{
+	if (m_viewMode == ViewMode::ContinuousScroll && m_archive) {
+		QPainter painter(this);
+		paintStrip(painter);
+		return;
+	}
+
+	const bool hasPage = m_viewMode == ViewMode::TwoPageSpread ? !m_frame.isNull() : !m_currImage.isNull();
+	if (!hasPage) {
+		QLabel::paintEvent(event);  // messages
+		return;
+	}
+
+	QPainter painter(this);
+	if (isZoomed()) {
+		paintZoomed(painter);
 		return;
+	}
 
-	setPixmap(m_currPixmap.scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));  // fit to current size
+	const QImage& animationFrame = m_animation.getCurrentFrame();
+	QRect frameRect(QPoint(0, 0), animationFrame.isNull() ? m_frame.size() : animationFrame.size());
+	frameRect.moveCenter(rect().center());
+	if (animationFrame.isNull())
+		painter.drawPixmap(frameRect.topLeft(), m_frame);
+	else
+		painter.drawImage(frameRect.topLeft(), animationFrame);
 }
 
 
 void ArchiveImageView::resizeEvent(QResizeEvent*)
 {
-	refreshView();
+	if (m_viewMode == ViewMode::ContinuousScroll) {
+		updateStripLayout();
+		m_resizeTimer.start();  // pages are rescaled to the new column width once resizing stops
+	}
+	else if (m_viewMode == ViewMode::TwoPageSpread) {
+		if (m_archive)
+			loadCurrSpreadFromArchive();  // recomposited only once both pages are there
+	}
+	else {
+		m_animation.setTargetSize(size());
+		refreshView();
+	}
+}
+
+
+// Ctrl+wheel zooms around the cursor; the plain wheel pans while zoomed in or scrolls the strip
+void ArchiveImageView::wheelEvent(QWheelEvent* event)
+{
+	if (m_viewMode == ViewMode::ContinuousScroll && m_archive) {
+		scrollStripTo(getStripPosition() - event->angleDelta().y() / 120.0 * QApplication::wheelScrollLines() * k_stripLineStep);
+		event->accept();
+		return;
+	}
+
+	if (m_currImage.isNull()) {
+		QLabel::wheelEvent(event);
+		return;
+	}
+
+	const QPoint& delta = event->angleDelta();
+	if (event->modifiers() & Qt::ControlModifier) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+		const QPointF cursorPos = event->position();
+#else
+		const QPointF cursorPos = event->posF();
+#endif
+		setZoom((isZoomed() ? m_zoom : getFitScale()) * std::pow(k_zoomStep, delta.y() / 120.0), cursorPos);
+		event->accept();
+	}
+	else if (isZoomed()) {
+		m_focus -= QPointF(delta) / m_zoom;
+		clampFocus();
+		update();
+		event->accept();
+	}
+	else {
+		QLabel::wheelEvent(event);
+	}
 }
 
+
+void ArchiveImageView::mousePressEvent(QMouseEvent* event)
+{
+	const bool isPannable = isZoomed() || (m_viewMode == ViewMode::ContinuousScroll && m_archive);
+	if (!isPannable || event->button() != Qt::LeftButton) {
+		QLabel::mousePressEvent(event);
+		return;
+	}
+
+	m_dragPos = event->pos();
+	setCursor(Qt::ClosedHandCursor);
+}
+
+
+void ArchiveImageView::mouseMoveEvent(QMouseEvent* event)
+{
+	if (m_viewMode == ViewMode::ContinuousScroll && m_archive && (event->buttons() & Qt::LeftButton)) {
+		const int delta = event->pos().y() - m_dragPos.y();
+		m_dragPos = event->pos();
+		scrollStripTo(getStripPosition() - delta);
+		return;
+	}
+	if (!isZoomed() || !(event->buttons() & Qt::LeftButton)) {
+		QLabel::mouseMoveEvent(event);
+		return;
+	}
+
+	m_focus -= QPointF(event->pos() - m_dragPos) / m_zoom;
+	m_dragPos = event->pos();
+	clampFocus();
+	update();
+}
+
+
+void ArchiveImageView::mouseReleaseEvent(QMouseEvent* event)
+{
+	if (event->button() == Qt::LeftButton)
+		unsetCursor();
+	QLabel::mouseReleaseEvent(event);
+}
@@ -19,16 +19,29 @@
 #ifndef ARCHIVEIMAGEVIEW_H
 #define ARCHIVEIMAGEVIEW_H
 
+#include <array>
 #include <cstdint>
 #include <memory>
 
+#include <QImage>
 #include <QLabel>
 #include <QPixmap>
+#include <QPoint>
+#include <QPointF>
+#include <QScrollBar>
+#include <QTimer>
 
+#include "animationplayer.h"
 #include "archive.h"
+#include "imagecache.h"
+#include "striplayout.h"
+#include "tilecache.h"
 
 
 
+// Shows one page of an archive, fitted to the view or zoomed in, two facing pages side by side, or
+// all pages stacked in a column which is scrolled through continuously. The label itself only shows
+// messages; pages are painted directly, from tiles when zoomed into pages which can be tiled.
 class ArchiveImageView : public QLabel
 {
 	Q_OBJECT
@@ -42,29 +55,97 @@ public:
 		Next
 	};
 
+	enum class ViewMode
+	{
+		SinglePage,
+		TwoPageSpread,
+		ContinuousScroll
+	};
+
 
 	explicit ArchiveImageView(QWidget* parent);
 
 	bool setArchive(std::shared_ptr<Archive>& archive);
-	inline size_t getCurrentIndex() const   { return m_index; }
+	void setPending(const QString& msg);
+	inline size_t getCurrentIndex() const   { return m_index; }  // the lower one of a spread; the top one of a strip
+	inline ViewMode getViewMode() const	{ return m_viewMode; }
 
 
 signals:
+	void indexChanged(size_t index);
+	void pageShown(size_t index);  // the final, high-quality frame is on screen
+
+
 public slots:
 	void rotate(Rotation target);
 	void setIndex(size_t index);
+	void setViewMode(ViewMode mode);
+	void setSpreadOptions(bool isRightToLeft, bool hasCoverPage);
+	void zoomIn();
+	void zoomOut();
+	void zoomToFit();
 
 
 private:
 	void loadCurrPixmapFromArchive();
+	void navigate();
+	void showPreview();
+	void onImageReady(size_t index);
+	void onResizeIdle();
 	void refreshView();
-
+	QSize getTargetSize() const;
+
+	// two-page spread
+	size_t getSpreadFirst(size_t index) const;  // of the spread which index is in
+	size_t getSpreadLast(size_t first) const;
+	void rotateSpread(Rotation target);
+	void loadCurrSpreadFromArchive();
+	void refreshSpread();
+
+	// continuous scroll
+	int getStripColumnWidth() const;
+	double getStripPosition() const;  // of the top of the view
+	void scrollStripTo(double y);
+	void rotateStrip(Rotation target);
+	void updateStripLayout();
+	void requestStripPages();
+	void paintStrip(QPainter& painter);
+
+	inline bool isZoomed() const	{ return m_zoom > 0.0; }
+	double getFitScale() const;
+	void setZoom(double zoom, const QPointF& anchor);  // the image point under anchor stays there
+	void clampFocus();
+	void paintZoomed(QPainter& painter);
+
+	virtual void paintEvent(QPaintEvent* event) override;
 	virtual void resizeEvent(QResizeEvent*) override;
+	virtual void wheelEvent(QWheelEvent* event) override;
+	virtual void mousePressEvent(QMouseEvent* event) override;
+	virtual void mouseMoveEvent(QMouseEvent* event) override;
+	virtual void mouseReleaseEvent(QMouseEvent* event) override;
 
 
 	std::shared_ptr<Archive> m_archive;
 	size_t m_index;
-	QPixmap m_currPixmap;  // img data before transform
+	bool m_isForward;  // direction of the last navigation or scrolling
+	ViewMode m_viewMode;
+	bool m_isRightToLeft;  // of spreads
+	bool m_hasCoverPage;  // the first page makes a spread on its own
+	QImage m_currImage;  // img data before transform
+	QSize m_fullSize;  // of the current page, which m_currImage may be a reduced version of
+	QPixmap m_frame;  // m_currImage fitted to the view, or the composited spread
+	std::array<QImage, 2> m_spreadPages;  // decoded pages of the current spread, lower index first
+	double m_zoom;  // view pixels per image pixel; 0 when fitted to the view
+	QPointF m_focus;  // image point at the centre of the view, in full-resolution pixels
+	QPoint m_dragPos;  // while panning
+	StripLayout m_stripLayout;
+	double m_stripOffset;  // how much of the page at the top is scrolled past, as a fraction of its height
+	QScrollBar* m_scrollBar;
+	ImageCache m_imageCache;
+	TileCache m_tileCache;
+	AnimationPlayer m_animation;  // of the current page in single page mode
+	QTimer m_resizeTimer;
+	QTimer m_settleTimer;  // running while navigation keeps coming in quick succession
 };
 
 
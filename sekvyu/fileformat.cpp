@@ -20,40 +20,83 @@
 
 
 
-// all assume LITTLE-endian
 namespace {
 
 
-inline bool CheckUint32(const uint8_t* data, uint32_t value)
-{
-	return *reinterpret_cast<const uint32_t*>(data) == value;
-}
+using Type = FileFormat::Type;
+
 
-inline bool CheckUint16(const uint8_t* data, uint16_t value)
+struct Signature
 {
-	return *reinterpret_cast<const uint16_t*>(data) == value;
-}
+	Type type;
+	const char* bytes;
+	const char* mask;  // 'x' where bytes must match; anything else where they may differ
+	size_t length;
+};
 
 
-bool IsJpeg(const uint8_t* rawData, size_t size)
+// in order of precedence
+// REF: https://en.wikipedia.org/wiki/List_of_file_signatures
+constexpr Signature k_signatures[] = {
+	{ Type::Jpeg,		"\xFF\xD8\xFF\xDB",								"xxxx",				4 },
+	{ Type::Jpeg,		"\xFF\xD8\xFF\xE0\0\0JFIF\0\x01",				"xxxx..xxxxxx",		12 },
+	{ Type::Jpeg,		"\xFF\xD8\xFF\xE1\0\0Exif\0\0",				"xxxx..xxxxxx",		12 },
+	{ Type::Jpeg,		"\xFF\xD8\xFF\xEE",								"xxxx",				4 },
+	{ Type::Png,		"\x89PNG\r\n\x1A\n",							"xxxxxxxx",			8 },
+	{ Type::Gif,		"GIF87a",										"xxxxxx",			6 },
+	{ Type::Gif,		"GIF89a",										"xxxxxx",			6 },
+	{ Type::Bmp,		"BM\0\0\0\0\0\0\0\0",							"xx....xxxx",		10 },  // zero reserved fields
+	{ Type::WebP,		"RIFF\0\0\0\0WEBP",								"xxxx....xxxx",		12 },
+	{ Type::Tiff,		"II*\0",										"xxxx",				4 },
+	{ Type::Tiff,		"MM\0*",										"xxxx",				4 },
+	{ Type::Avif,		"\0\0\0\0ftypavif",								"....xxxxxxxx",		12 },
+	{ Type::Avif,		"\0\0\0\0ftypavis",								"....xxxxxxxx",		12 },
+	{ Type::Heif,		"\0\0\0\0ftypheic",								"....xxxxxxxx",		12 },
+	{ Type::Heif,		"\0\0\0\0ftypheix",								"....xxxxxxxx",		12 },
+	{ Type::Heif,		"\0\0\0\0ftypmif1",								"....xxxxxxxx",		12 },
+	{ Type::Heif,		"\0\0\0\0ftypmsf1",								"....xxxxxxxx",		12 },
+	{ Type::JpegXl,		"\xFF\x0A",										"xx",				2 },
+	{ Type::JpegXl,		"\0\0\0\x0CJXL \r\n\x87\n",						"xxxxxxxxxxxx",		12 },
+	{ Type::SevenZip,	"7z\xBC\xAF\x27\x1C",								"xxxxxx",			6 },
+};
+
+constexpr size_t k_numSignatures = sizeof(k_signatures) / sizeof(k_signatures[0]);
+static_assert(k_numSignatures <= 32, "candidate sets are 32-bit masks");
+
+
+// For each value of the first byte, the set of signatures worth trying: those starting with that
+// value and those whose first byte is a wildcard.
+struct DispatchTable
 {
-	if (size > 4 && CheckUint32(rawData, 0xDBFFD8FF))
-		return true;
-	if (size > 12 && CheckUint32(rawData, 0xE0FFD8FF) && CheckUint16(rawData+6, 0x464A) && CheckUint32(rawData+8, 0x01004649))
-		return true;
-	if (size > 12 && CheckUint32(rawData, 0xE1FFD8FF) && CheckUint16(rawData+6, 0x7845) && CheckUint32(rawData+8, 0x00006669))
-		return true;
-	return false;
-}
+	uint32_t candidates[256];
+};
 
-bool IsPng(const uint8_t* rawData, size_t size)
+constexpr DispatchTable MakeDispatchTable()
 {
-	return (size > 8 && CheckUint32(rawData, 0x474E5089) && CheckUint32(rawData+4, 0x0A1A0A0D));
+	DispatchTable table = {};
+	for (size_t value = 0; value < 256; ++value) {
+		for (size_t i = 0; i < k_numSignatures; ++i) {
+			const auto& signature = k_signatures[i];
+			if (signature.mask[0] != 'x' || static_cast<uint8_t>(signature.bytes[0]) == value)
+				table.candidates[value] |= 1u << i;
+		}
+	}
+	return table;
 }
 
-bool IsSevenZip(const uint8_t* rawData, size_t size)
+constexpr DispatchTable k_dispatchTable = MakeDispatchTable();
+
+
+// byte by byte, so data need not be aligned
+bool Matches(const Signature& signature, const uint8_t* rawData, size_t size)
 {
-	return (size > 6 && CheckUint32(rawData, 0xAFBC7A37) && CheckUint16(rawData+4, 0x1C27));
+	if (size < signature.length)
+		return false;
+	for (size_t i = 0; i < signature.length; ++i) {
+		if (signature.mask[i] == 'x' && rawData[i] != static_cast<uint8_t>(signature.bytes[i]))
+			return false;
+	}
+	return true;
 }
 
 
@@ -61,15 +104,38 @@ bool IsSevenZip(const uint8_t* rawData, size_t size)
 
 
 
-// REF: https://en.wikipedia.org/wiki/List_of_file_signatures
 FileFormat::Type FileFormat::GetType(const uint8_t* rawData, size_t size)
 {
-#define CHECK(type)	 { if (Is##type##(rawData, size)) return Type::##type##; }
-	CHECK(Jpeg);
-	CHECK(Png);
-	CHECK(SevenZip);
-#undef CHECK
-
+	if (rawData == nullptr || size == 0)
+		return Type::Unknown;
+
+	uint32_t candidates = k_dispatchTable.candidates[rawData[0]];
+	for (size_t i = 0; candidates != 0; ++i, candidates >>= 1) {
+		if ((candidates & 1) != 0 && Matches(k_signatures[i], rawData, size))
+			return k_signatures[i].type;
+	}
 	return Type::Unknown;
 }
 
+
+bool FileFormat::IsImage(Type type)
+{
+	return GetQtFormat(type) != nullptr;
+}
+
+
+const char* FileFormat::GetQtFormat(Type type)
+{
+	switch (type) {
+		case Type::Jpeg:	return "jpeg";
+		case Type::Png:		return "png";
+		case Type::Gif:		return "gif";
+		case Type::Bmp:		return "bmp";
+		case Type::WebP:	return "webp";
+		case Type::Tiff:	return "tiff";
+		case Type::Avif:	return "avif";
+		case Type::Heif:	return "heif";
+		case Type::JpegXl:	return "jxl";
+		default:			return nullptr;
+	}
+}
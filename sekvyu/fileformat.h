@@ -19,6 +19,7 @@
 #ifndef FILEFORMAT_H
 #define FILEFORMAT_H
 
+#include <cstddef>
 #include <cstdint>
 
 
@@ -29,6 +30,13 @@ public:
 		// images
 		Jpeg,
 		Png,
+		Gif,
+		Bmp,
+		WebP,
+		Tiff,
+		Avif,
+		Heif,
+		JpegXl,
 
 		// archives
 		SevenZip,
@@ -37,6 +45,8 @@ public:
 	};
 
 	static Type GetType(const uint8_t* rawData, size_t size);
+	static bool IsImage(Type type);
+	static const char* GetQtFormat(Type type);  // for QImageReader; nullptr for non-images
 };
 
 
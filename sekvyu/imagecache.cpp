@@ -0,0 +1,350 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imagecache.h"
+
+#include <algorithm>
+
+#include "imagedecoder.h"
+#include "imagescaler.h"
+#include "securearena.h"
+
+
+
+namespace {
+
+
+constexpr size_t k_defaultBudget = 512 * 1024 * 1024;
+constexpr size_t k_arenaSize = k_defaultBudget + k_defaultBudget / 4;  // room for images being decoded
+constexpr size_t k_minArenaSize = 64 * 1024 * 1024;
+constexpr size_t k_decodedPerExtracted = 8;  // roughly, for JPEGs at typical quality
+constexpr size_t k_numAhead = 3;  // pages prefetched in the reading direction
+constexpr size_t k_numBehind = 1;  // pages prefetched against it
+
+constexpr int k_previewDivisor = 4;  // of the target size; JPEGs get decoded at 1/4 or 1/8
+
+
+QImage ScaleImage(const QImage& image, const QSize& targetSize)
+{
+	if (image.isNull() || targetSize.isEmpty())
+		return QImage();
+	return SecureArena::CopyToArena(ImageScaler::Scale(image, targetSize));  // fit to target size
+}
+
+
+size_t GetEntrySize(const QImage& image, const QImage& scaled)
+{
+	return static_cast<size_t>(image.sizeInBytes() + scaled.sizeInBytes());
+}
+
+
+}  // unnamed namespace
+
+
+
+ImageCache::ImageCache(QObject* parent)
+	: QObject(parent)
+	, m_archive()
+	, m_tasks()
+	, m_budget(k_defaultBudget)
+	, m_usage(0)
+	, m_shownFirst(0)
+	, m_shownLast(0)
+	, m_isPreviewOnly(false)
+	, m_targetSize()
+	, m_entries()
+	, m_lru()
+	, m_pending()
+	, m_generation(0)
+	, m_windowBegin(0)
+	, m_windowEnd(0)
+{
+	SecureArena::GetInstance().Reserve(k_arenaSize, true);  // address space only; sized per archive
+	SecureArena::GetInstance().Resize(k_minArenaSize);
+}
+
+ImageCache::~ImageCache()
+{
+	for (const auto& pending : m_pending)
+		pending.second.Cancel();
+	m_tasks.Wait();
+}
+
+
+void ImageCache::setArchive(const std::shared_ptr<Archive>& archive)
+{
+	++m_generation;  // results of queued and running tasks will be discarded
+	for (const auto& pending : m_pending)
+		pending.second.Cancel();
+
+	m_archive = archive;
+	m_entries.clear();
+	m_lru.clear();
+	m_pending.clear();
+	m_usage = 0;
+	m_shownFirst = 0;
+	m_shownLast = 0;
+	m_isPreviewOnly = false;
+	m_windowBegin = 0;
+	m_windowEnd = 0;
+
+	// decoded pages are several times the size of their files, and no more than the budget is kept
+	size_t extractedSize = 0;
+	for (size_t index = 0; archive && index < archive->GetFileCount(); ++index) {
+		const auto& data = archive->GetFileData(index);
+		extractedSize += data ? data->GetSize() : 0;
+	}
+	SecureArena::GetInstance().Resize(std::min(std::max(extractedSize * k_decodedPerExtracted, k_minArenaSize), k_arenaSize));
+}
+
+
+void ImageCache::setBudget(size_t bytes)
+{
+	m_budget = bytes;
+	evict();
+}
+
+
+// Frames scaled for the old size are kept until replaced, so the view can still use their images.
+// Pages around the shown ones are mostly only rescaled, which can wait until the cores are idle.
+void ImageCache::setTargetSize(const QSize& size)
+{
+	if (size == m_targetSize)
+		return;
+
+	m_targetSize = size;
+	for (size_t index = m_shownFirst; index <= m_shownLast; ++index)
+		schedule(index, TaskScheduler::Priority::Visible, false);
+	for (size_t index = m_windowBegin; index < m_windowEnd; ++index)
+		schedule(index, TaskScheduler::Priority::Idle, false);
+}
+
+
+bool ImageCache::lookup(size_t index, QImage& outImage)
+{
+	auto itr = m_entries.find(index);
+	if (itr == m_entries.end())
+		return false;
+
+	m_lru.splice(m_lru.begin(), m_lru, itr->second.lruPos);
+	outImage = itr->second.frames.image;
+	return true;
+}
+
+
+bool ImageCache::lookupScaled(size_t index, QImage& outImage)
+{
+	auto itr = m_entries.find(index);
+	if (itr == m_entries.end() || itr->second.frames.scaled.isNull() || itr->second.frames.scaledFor != m_targetSize)
+		return false;
+
+	m_lru.splice(m_lru.begin(), m_lru, itr->second.lruPos);
+	outImage = itr->second.frames.scaled;
+	return true;
+}
+
+
+QSize ImageCache::getFullSize(size_t index) const
+{
+	auto itr = m_entries.find(index);
+	return itr != m_entries.end() ? itr->second.frames.fullSize : QSize();
+}
+
+
+void ImageCache::request(size_t index)
+{
+	m_shownFirst = index;
+	m_shownLast = index;
+	m_isPreviewOnly = false;
+	if (m_windowBegin > index || m_windowEnd <= index)
+		setWindow(index, index + 1);
+	schedule(index, TaskScheduler::Priority::Visible, false);
+}
+
+
+// For navigation going faster than pages can be decoded. Everything in flight for other pages is
+// abandoned, and the page gets no full decode until it is requested normally.
+void ImageCache::requestPreview(size_t index)
+{
+	m_shownFirst = index;
+	m_shownLast = index;
+	m_isPreviewOnly = true;
+	setWindow(index, index + 1);
+	schedule(index, TaskScheduler::Priority::Visible, true);
+}
+
+
+void ImageCache::prefetch(size_t center, bool isForward)
+{
+	if (!m_archive)
+		return;
+
+	m_shownFirst = center;
+	m_shownLast = center;
+	m_isPreviewOnly = false;
+	scheduleAround(center, center, isForward);
+}
+
+
+// pages on screen are scheduled in the reading direction, before the ones around them
+void ImageCache::requestRange(size_t first, size_t last, bool isForward)
+{
+	if (!m_archive || m_archive->GetFileCount() == 0)
+		return;
+
+	last = std::min(last, m_archive->GetFileCount() - 1);
+	m_shownFirst = first;
+	m_shownLast = last;
+	m_isPreviewOnly = false;
+	scheduleAround(first, last, isForward);  // sets the window before anything in it is scheduled
+	for (size_t i = 0; i <= last - first; ++i)
+		schedule(isForward ? first + i : last - i, TaskScheduler::Priority::Visible, false);
+}
+
+
+// Prefetches pages before first and after last, nearest first, alternating towards the reading
+// direction. Anything outside of them and [first, last] is left to go stale.
+void ImageCache::scheduleAround(size_t first, size_t last, bool isForward)
+{
+	const size_t fileCount = m_archive->GetFileCount();
+	const size_t numAfter = isForward ? k_numAhead : k_numBehind;
+	const size_t numBefore = isForward ? k_numBehind : k_numAhead;
+
+	setWindow(first > numBefore ? first - numBefore : 0, std::min(last + numAfter + 1, fileCount));
+	for (size_t dist = 1; dist <= std::max(numAfter, numBefore); ++dist) {
+		if (dist <= numAfter && last + dist < fileCount)
+			schedule(last + dist, TaskScheduler::Priority::Prefetch, false);
+		if (dist <= numBefore && first >= dist)
+			schedule(first - dist, TaskScheduler::Priority::Prefetch, false);
+	}
+}
+
+
+// pending decodes which have left the window are cancelled right away, running ones included
+void ImageCache::setWindow(size_t begin, size_t end)
+{
+	m_windowBegin = begin;
+	m_windowEnd = end;
+	for (const auto& pending : m_pending) {
+		if (pending.first < begin || pending.first >= end)
+			pending.second.Cancel();
+	}
+}
+
+
+// Schedules either a decode, or only a rescale if the decoded image is still large enough for the
+// current target size. A reduced-resolution decode which is not gets decoded again. Previews are
+// only made of pages not cached at all, in formats which decode faster at a lower resolution.
+void ImageCache::schedule(size_t index, TaskScheduler::Priority priority, bool isPreview)
+{
+	if (!m_archive || m_pending.count(index) > 0)
+		return;
+
+	std::shared_ptr<Buffer> buffer;
+	const auto type = m_archive->GetFileType(index);
+	isPreview = isPreview && ImageDecoder::CanDecodeReduced(type);  // otherwise no quicker than the real thing
+	Frames frames;
+	auto itr = m_entries.find(index);
+	if (itr != m_entries.end()) {
+		const auto& cached = itr->second.frames;
+		if (isPreview || cached.image.isNull() || cached.scaledFor == m_targetSize)
+			return;  // failed to decode, or nothing to do
+		else if (ImageDecoder::IsLargeEnough(cached.image, cached.fullSize, m_targetSize))
+			frames = cached;
+	}
+	if (frames.image.isNull()) {
+		buffer = m_archive->GetFileData(index);
+		if (!buffer)
+			return;
+	}
+
+	auto token = CancellationToken::Create();
+	m_pending[index] = token;
+	unsigned int generation = m_generation;
+	QSize targetSize = m_targetSize;
+	m_tasks.Submit(priority, token, [this, buffer, type, frames, generation, index, targetSize, isPreview, token](bool isStale) mutable {
+		auto isStaleNow = [token]() { return token.IsCancelled(); };
+		if (!isStale) {
+			if (buffer)
+				frames.image = ImageDecoder::Decode(buffer, type, isPreview ? targetSize / k_previewDivisor : targetSize, frames.fullSize, isStaleNow);
+			if (isPreview) {
+				frames.isPreview = true;
+			}
+			else {
+				frames.scaled = ScaleImage(frames.image, targetSize);
+				frames.scaledFor = targetSize;
+			}
+			isStale = isStaleNow();  // possibly abandoned midway
+		}
+		QMetaObject::invokeMethod(this, [this, generation, index, frames, isStale]() {
+			onDecoded(generation, index, frames, isStale);
+		}, Qt::QueuedConnection);
+	} );
+}
+
+
+void ImageCache::onDecoded(unsigned int generation, size_t index, const Frames& frames, bool isDropped)
+{
+	if (generation != m_generation)
+		return;  // belongs to a previous archive
+
+	const auto priority = isShown(index) ? TaskScheduler::Priority::Visible : TaskScheduler::Priority::Prefetch;
+	m_pending.erase(index);
+	if (isDropped) {
+		if (index >= m_windowBegin && index < m_windowEnd)
+			schedule(index, priority, m_isPreviewOnly);  // the window has moved back to it since
+		return;
+	}
+
+	insert(index, frames);
+	emit imageReady(index);
+
+	if (frames.isPreview ? isShown(index) && !m_isPreviewOnly : frames.scaledFor != m_targetSize)
+		schedule(index, priority, false);  // the full decode after a preview, or the target changed meanwhile
+}
+
+
+void ImageCache::insert(size_t index, const Frames& frames)
+{
+	auto itr = m_entries.find(index);
+	if (itr != m_entries.end()) {
+		m_usage -= GetEntrySize(itr->second.frames.image, itr->second.frames.scaled);
+		m_lru.erase(itr->second.lruPos);
+	}
+
+	m_lru.push_front(index);
+	m_entries[index] = Entry{ frames, m_lru.begin() };
+	m_usage += GetEntrySize(frames.image, frames.scaled);
+	evict();
+}
+
+
+void ImageCache::evict()
+{
+	auto itr = m_lru.end();
+	while (m_usage > m_budget && itr != m_lru.begin()) {
+		--itr;
+		if (isShown(*itr))
+			continue;  // never drop pages on screen
+
+		auto entry = m_entries.find(*itr);
+		m_usage -= GetEntrySize(entry->second.frames.image, entry->second.frames.scaled);
+		m_entries.erase(entry);
+		itr = m_lru.erase(itr);
+	}
+}
@@ -0,0 +1,114 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+
+#include "archive.h"
+#include "taskscheduler.h"
+
+
+
+// Decodes images of an archive on the shared task scheduler and keeps the most recently used ones,
+// bounded by the total size of decoded pixels. Along with each image a frame pre-scaled to the
+// target size is kept so that the view can show it as is. While the view is scrubbing, pages are
+// only decoded as quick low-resolution previews. Decodes of pages which leave the window around
+// the shown ones are cancelled, even midway. All public methods are meant to be called from the
+// GUI thread.
+class ImageCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ImageCache(QObject* parent = nullptr);
+	~ImageCache();
+
+	void setArchive(const std::shared_ptr<Archive>& archive);
+	void setBudget(size_t bytes);
+	void setTargetSize(const QSize& size);
+	inline const QSize& getTargetSize() const	{ return m_targetSize; }
+
+	bool lookup(size_t index, QImage& outImage);  // a null outImage means decoding has failed
+	bool lookupScaled(size_t index, QImage& outImage);  // only succeeds for the current target size
+	QSize getFullSize(size_t index) const;  // invalid if not decoded yet
+	void request(size_t index);
+	void prefetch(size_t center, bool isForward);
+	void requestRange(size_t first, size_t last, bool isForward);  // for several pages on screen at once
+	void requestPreview(size_t index);  // only a preview, and nothing else, until the next request
+
+
+signals:
+	void imageReady(size_t index);
+
+
+private:
+	struct Frames
+	{
+		QImage image;  // JPEGs may be decoded at a reduced resolution still large enough for scaledFor
+		QSize fullSize;
+		QImage scaled;
+		QSize scaledFor;  // target size when the scaled frame was made
+		bool isPreview = false;  // image is only good enough to show while navigating
+	};
+
+	struct Entry
+	{
+		Frames frames;
+		std::list<size_t>::iterator lruPos;
+	};
+
+	inline bool isShown(size_t index) const	{ return index >= m_shownFirst && index <= m_shownLast; }
+	void schedule(size_t index, TaskScheduler::Priority priority, bool isPreview);
+	void scheduleAround(size_t first, size_t last, bool isForward);
+	void setWindow(size_t begin, size_t end);
+	void onDecoded(unsigned int generation, size_t index, const Frames& frames, bool isDropped);
+	void insert(size_t index, const Frames& frames);
+	void evict();
+
+
+	std::shared_ptr<Archive> m_archive;
+	TaskGroup m_tasks;
+	size_t m_budget;
+	size_t m_usage;
+	size_t m_shownFirst;  // pages on screen, which are never evicted
+	size_t m_shownLast;
+	bool m_isPreviewOnly;  // previews of shown pages are not followed by full decodes
+	QSize m_targetSize;
+
+	std::unordered_map<size_t, Entry> m_entries;
+	std::list<size_t> m_lru;  // most recently used at front
+	std::unordered_map<size_t, CancellationToken> m_pending;
+
+	unsigned int m_generation;  // of the archive, for results of tasks which were running when it changed
+	size_t m_windowBegin;  // pages worth decoding; anything pending outside of them is cancelled
+	size_t m_windowEnd;
+};
+
+
+
+#endif // IMAGECACHE_H
+
@@ -0,0 +1,177 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imagedecoder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QImageReader>
+
+#include "securearena.h"
+#include "trace.h"
+
+
+
+namespace {
+
+
+// Pages of formats which cannot be tiled are kept at most this large, so that their memory is
+// bounded as well. Zooming into them beyond it only magnifies.
+constexpr double k_maxUntiledPixels = 8192.0 * 4096.0;
+
+
+// Largest power-of-two reduction (up to 1/8, which libjpeg can do in the DCT domain) with which
+// an image of fullSize still covers the frame fitted into targetSize.
+int GetJpegScaleDenominator(const QSize& fullSize, const QSize& targetSize)
+{
+	if (!fullSize.isValid() || targetSize.isEmpty())
+		return 1;
+
+	const QSize fitted = fullSize.scaled(targetSize, Qt::KeepAspectRatio);
+	int denom = 8;
+	while (denom > 1 && (fullSize.width() / denom < fitted.width() || fullSize.height() / denom < fitted.height()))
+		denom /= 2;
+	return denom;
+}
+
+
+// Lets a decode be abandoned midway. Image handlers pull data in small chunks and give up on a
+// failed read as they would on a truncated file.
+class CancellableBuffer : public QBuffer
+{
+public:
+	CancellableBuffer(QByteArray* data, const std::function<bool()>& isCancelled)
+		: QBuffer(data)
+		, m_isCancelled(isCancelled)
+	{
+	}
+
+
+protected:
+	virtual qint64 readData(char* data, qint64 maxSize) override
+	{
+		if (m_isCancelled && m_isCancelled())
+			return -1;
+		return QBuffer::readData(data, maxSize);
+	}
+
+
+private:
+	std::function<bool()> m_isCancelled;
+};
+
+
+// Qt's JPEG handler decodes colour images straight into a given RGB32 image of the right size, so
+// only then is the arena image made up front. Anything else is decoded on the heap and copied once.
+QImage ReadImage(QImageReader& reader, FileFormat::Type type, const QSize& expectedSize)
+{
+	const bool isInPlace = type == FileFormat::Type::Jpeg && expectedSize.isValid() && reader.imageFormat() == QImage::Format_RGB32;
+	QImage image = isInPlace ? SecureArena::CreateImage(expectedSize, QImage::Format_RGB32) : QImage();
+	if (!reader.read(&image))
+		return QImage();
+
+	// converting here saves a conversion on the GUI thread when the image becomes a pixmap
+	auto format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+	return SecureArena::CopyToArena(image.format() == format ? image : image.convertToFormat(format));
+}
+
+
+}  // unnamed namespace
+
+
+
+QImage ImageDecoder::Decode(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QSize& targetSize, QSize& outFullSize,
+	const std::function<bool()>& isCancelled)
+{
+	TRACE_SCOPE("ImageDecoder::Decode");
+
+	auto data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer->GetData()), static_cast<int>(buffer->GetSize()));
+	CancellableBuffer device(&data, isCancelled);
+	device.open(QIODevice::ReadOnly);
+	QImageReader reader(&device, FileFormat::GetQtFormat(type));
+
+	outFullSize = reader.size();
+	if (type == FileFormat::Type::Jpeg) {
+		const int denom = GetJpegScaleDenominator(outFullSize, targetSize);
+		if (denom > 1)
+			reader.setScaledSize(QSize(outFullSize.width() / denom, outFullSize.height() / denom));
+	}
+	else if (!CanDecodeRegion(type) && outFullSize.isValid()) {
+		// the handler still decodes at full size, but only for as long as the decode takes
+		const double pixels = static_cast<double>(outFullSize.width()) * outFullSize.height();
+		if (pixels > k_maxUntiledPixels) {
+			const double factor = std::sqrt(k_maxUntiledPixels / pixels);
+			reader.setScaledSize(QSize(std::max(static_cast<int>(outFullSize.width() * factor), 1), std::max(static_cast<int>(outFullSize.height() * factor), 1)));
+		}
+	}
+
+	const QImage& image = ReadImage(reader, type, reader.scaledSize().isValid() ? reader.scaledSize() : outFullSize);
+	if (isCancelled && isCancelled())
+		return QImage();  // whatever was read is incomplete
+	if (!outFullSize.isValid())
+		outFullSize = image.size();
+	return image;
+}
+
+
+// Only the rows down to the bottom of region are decoded and only region is kept, at a reduced
+// resolution in the DCT domain where outputSize allows.
+QImage ImageDecoder::DecodeRegion(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QRect& region, const QSize& outputSize,
+	const std::function<bool()>& isCancelled)
+{
+	TRACE_SCOPE("ImageDecoder::DecodeRegion");
+
+	if (!CanDecodeRegion(type) || region.isEmpty() || outputSize.isEmpty())
+		return QImage();
+
+	auto data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer->GetData()), static_cast<int>(buffer->GetSize()));
+	CancellableBuffer device(&data, isCancelled);
+	device.open(QIODevice::ReadOnly);
+	QImageReader reader(&device, FileFormat::GetQtFormat(type));
+	reader.setClipRect(region);
+	if (outputSize != region.size())
+		reader.setScaledSize(outputSize);
+	const QImage& image = ReadImage(reader, type, outputSize);
+	return isCancelled && isCancelled() ? QImage() : image;
+}
+
+
+// other handlers would decode the whole image for every region
+bool ImageDecoder::CanDecodeRegion(FileFormat::Type type)
+{
+	return type == FileFormat::Type::Jpeg;
+}
+
+
+bool ImageDecoder::CanDecodeReduced(FileFormat::Type type)
+{
+	return type == FileFormat::Type::Jpeg;
+}
+
+
+bool ImageDecoder::IsLargeEnough(const QImage& image, const QSize& fullSize, const QSize& targetSize)
+{
+	if (image.size() == fullSize || targetSize.isEmpty())
+		return true;
+
+	const QSize fitted = fullSize.scaled(targetSize, Qt::KeepAspectRatio);
+	return image.width() >= fitted.width() && image.height() >= fitted.height();
+}
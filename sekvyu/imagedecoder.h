@@ -0,0 +1,58 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <functional>
+#include <memory>
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+
+// Extract7Z
+#include <Buffer.h>
+
+#include "fileformat.h"
+
+
+
+// Decodes images of an archive into the secure arena, JPEGs at a reduced resolution when that is
+// still large enough for the size they are going to be shown at.
+class ImageDecoder
+{
+public:
+	// An empty targetSize decodes at full resolution. Passing the sniffed type saves Qt from probing
+	// its image plugins one by one. Once isCancelled returns true the decode is abandoned midway and
+	// a null image is returned.
+	static QImage Decode(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QSize& targetSize, QSize& outFullSize,
+		const std::function<bool()>& isCancelled = nullptr);
+
+	// part of a full-resolution image scaled to outputSize; only supported for some formats
+	static QImage DecodeRegion(const std::shared_ptr<Buffer>& buffer, FileFormat::Type type, const QRect& region, const QSize& outputSize,
+		const std::function<bool()>& isCancelled = nullptr);
+	static bool CanDecodeRegion(FileFormat::Type type);
+	static bool CanDecodeReduced(FileFormat::Type type);  // for less than a full decode costs
+
+	static bool IsLargeEnough(const QImage& image, const QSize& fullSize, const QSize& targetSize);
+};
+
+
+
+#endif // IMAGEDECODER_H
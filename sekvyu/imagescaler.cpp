@@ -0,0 +1,413 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imagescaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "securearena.h"
+#include "taskscheduler.h"
+#include "trace.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SEKVYU_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_SSE2
+		#define TARGET_AVX2
+	#else
+		#define TARGET_SSE2		__attribute__((target("sse2")))
+		#define TARGET_AVX2		__attribute__((target("avx2")))
+	#endif  // _MSC_VER
+#endif  // x86
+
+
+
+// Both passes use 14-bit fixed-point weights which sum up to exactly 1 << k_weightBits for each
+// output pixel. The horizontal pass keeps k_fracBits extra bits of precision in 16-bit values,
+// small enough to stay within a signed 16-bit lane so that pmaddwd can be used in both passes.
+namespace {
+
+
+constexpr int k_weightBits = 14;
+constexpr int k_fracBits = 7;
+constexpr int k_minRowsPerBand = 64;
+
+
+// contributions of source pixels to each output pixel along one axis
+struct Contributions
+{
+	std::vector<int> first;  // first source pixel
+	std::vector<int> count;  // number of source pixels
+	std::vector<int> offset;  // into weights
+	std::vector<int16_t> weights;
+	int maxCount;
+};
+
+
+Contributions CalcContributions(int srcLen, int dstLen)
+{
+	Contributions result;
+	result.first.resize(dstLen);
+	result.count.resize(dstLen);
+	result.offset.resize(dstLen);
+	result.maxCount = 0;
+
+	const double scale = static_cast<double>(srcLen) / dstLen;
+	for (int i = 0; i < dstLen; ++i) {
+		const double start = i * scale;
+		const double end = std::min((i + 1) * scale, static_cast<double>(srcLen));
+		const int first = std::min(static_cast<int>(start), srcLen - 1);
+		const int last = std::max(std::min(static_cast<int>(std::ceil(end)), srcLen), first + 1);
+
+		result.first[i] = first;
+		result.count[i] = last - first;
+		result.offset[i] = static_cast<int>(result.weights.size());
+		result.maxCount = std::max(result.maxCount, last - first);
+
+		// quantize, then give the rounding error to the largest weight so that they sum up exactly
+		int sum = 0;
+		int16_t largestWeight = -1;
+		size_t largest = result.weights.size();
+		for (int j = first; j < last; ++j) {
+			const double coverage = std::min(end, j + 1.0) - std::max(start, static_cast<double>(j));
+			const auto weight = static_cast<int16_t>(std::lround(coverage / scale * (1 << k_weightBits)));
+			if (weight > largestWeight) {
+				largestWeight = weight;
+				largest = result.weights.size();
+			}
+			result.weights.push_back(weight);
+			sum += weight;
+		}
+		result.weights[largest] = static_cast<int16_t>(result.weights[largest] + (1 << k_weightBits) - sum);
+	}
+	return result;
+}
+
+
+using RowScaler = void (*)(const uint32_t* src, int16_t* dst, const Contributions& contrib);
+using RowBlender = void (*)(const int16_t* const* rows, const int16_t* weights, int count, uint8_t* dst, int numValues);
+
+
+// horizontal pass: one row of 32-bit pixels into 4 x int16 per output pixel
+// vertical pass: weighted sum of horizontally scaled rows into one row of output pixels
+
+void ScaleRowScalar(const uint32_t* src, int16_t* dst, const Contributions& contrib)
+{
+	const int dstLen = static_cast<int>(contrib.first.size());
+	for (int i = 0; i < dstLen; ++i) {
+		const uint32_t* pixels = src + contrib.first[i];
+		const int16_t* weights = contrib.weights.data() + contrib.offset[i];
+		int32_t acc[4] = { 0, 0, 0, 0 };
+		for (int k = 0; k < contrib.count[i]; ++k) {
+			for (int c = 0; c < 4; ++c)
+				acc[c] += weights[k] * static_cast<int32_t>((pixels[k] >> (c * 8)) & 0xFF);
+		}
+		for (int c = 0; c < 4; ++c)
+			dst[i * 4 + c] = static_cast<int16_t>((acc[c] + (1 << (k_weightBits - k_fracBits - 1))) >> (k_weightBits - k_fracBits));
+	}
+}
+
+
+void BlendRowsScalar(const int16_t* const* rows, const int16_t* weights, int count, uint8_t* dst, int numValues)
+{
+	constexpr int shift = k_weightBits + k_fracBits;
+	for (int x = 0; x < numValues; ++x) {
+		int32_t acc = 0;
+		for (int k = 0; k < count; ++k)
+			acc += weights[k] * rows[k][x];
+		dst[x] = static_cast<uint8_t>(std::min((acc + (1 << (shift - 1))) >> shift, 255));
+	}
+}
+
+
+#ifdef SEKVYU_X86
+
+TARGET_SSE2 inline __m128i MulAddPixelPair(uint32_t p0, uint32_t p1, int16_t w0, int16_t w1)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pair = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(p0)), _mm_cvtsi32_si128(static_cast<int>(p1)));
+	const __m128i weights = _mm_set1_epi32((static_cast<int>(w1) << 16) | static_cast<uint16_t>(w0));
+	return _mm_madd_epi16(_mm_unpacklo_epi8(pair, zero), weights);  // a0*w0+b0*w1, ..., a3*w0+b3*w1
+}
+
+
+TARGET_SSE2 void ScaleRowSse2(const uint32_t* src, int16_t* dst, const Contributions& contrib)
+{
+	const __m128i rounding = _mm_set1_epi32(1 << (k_weightBits - k_fracBits - 1));
+	const int dstLen = static_cast<int>(contrib.first.size());
+	for (int i = 0; i < dstLen; ++i) {
+		const uint32_t* pixels = src + contrib.first[i];
+		const int16_t* weights = contrib.weights.data() + contrib.offset[i];
+		const int count = contrib.count[i];
+
+		__m128i acc = _mm_setzero_si128();
+		int k = 0;
+		for (; k + 1 < count; k += 2)
+			acc = _mm_add_epi32(acc, MulAddPixelPair(pixels[k], pixels[k + 1], weights[k], weights[k + 1]));
+		if (k < count)
+			acc = _mm_add_epi32(acc, MulAddPixelPair(pixels[k], 0, weights[k], 0));
+
+		acc = _mm_srai_epi32(_mm_add_epi32(acc, rounding), k_weightBits - k_fracBits);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packs_epi32(acc, acc));
+	}
+}
+
+
+TARGET_AVX2 void ScaleRowAvx2(const uint32_t* src, int16_t* dst, const Contributions& contrib)
+{
+	const __m128i rounding = _mm_set1_epi32(1 << (k_weightBits - k_fracBits - 1));
+	const int dstLen = static_cast<int>(contrib.first.size());
+	for (int i = 0; i < dstLen; ++i) {
+		const uint32_t* pixels = src + contrib.first[i];
+		const int16_t* weights = contrib.weights.data() + contrib.offset[i];
+		const int count = contrib.count[i];
+
+		// four source pixels per iteration: pixels k, k+1 in the lower lane and k+2, k+3 in the upper
+		__m256i acc = _mm256_setzero_si256();
+		int k = 0;
+		for (; k + 3 < count; k += 4) {
+			const __m128i quad = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + k));
+			const __m128i pair01 = _mm_unpacklo_epi8(quad, _mm_srli_si128(quad, 4));
+			const __m128i pair23 = _mm_unpacklo_epi8(_mm_srli_si128(quad, 8), _mm_srli_si128(quad, 12));
+			const __m256i values = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(pair01, pair23));
+			const int w01 = (static_cast<int>(weights[k + 1]) << 16) | static_cast<uint16_t>(weights[k]);
+			const int w23 = (static_cast<int>(weights[k + 3]) << 16) | static_cast<uint16_t>(weights[k + 2]);
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(values, _mm256_setr_epi32(w01, w01, w01, w01, w23, w23, w23, w23)));
+		}
+		__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		for (; k + 1 < count; k += 2)
+			sum = _mm_add_epi32(sum, MulAddPixelPair(pixels[k], pixels[k + 1], weights[k], weights[k + 1]));
+		if (k < count)
+			sum = _mm_add_epi32(sum, MulAddPixelPair(pixels[k], 0, weights[k], 0));
+
+		sum = _mm_srai_epi32(_mm_add_epi32(sum, rounding), k_weightBits - k_fracBits);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packs_epi32(sum, sum));
+	}
+}
+
+
+TARGET_SSE2 void BlendRowsSse2(const int16_t* const* rows, const int16_t* weights, int count, uint8_t* dst, int numValues)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rounding = _mm_set1_epi32(1 << (k_weightBits + k_fracBits - 1));
+	int x = 0;
+	for (; x + 8 <= numValues; x += 8) {
+		__m128i accLo = _mm_setzero_si128();
+		__m128i accHi = _mm_setzero_si128();
+		for (int k = 0; k < count; k += 2) {
+			const bool hasPair = k + 1 < count;
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + x));
+			const __m128i b = hasPair ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + x)) : zero;
+			const int16_t wb = hasPair ? weights[k + 1] : 0;
+			const __m128i w = _mm_set1_epi32((static_cast<int>(wb) << 16) | static_cast<uint16_t>(weights[k]));
+			accLo = _mm_add_epi32(accLo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+			accHi = _mm_add_epi32(accHi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+		}
+		accLo = _mm_srai_epi32(_mm_add_epi32(accLo, rounding), k_weightBits + k_fracBits);
+		accHi = _mm_srai_epi32(_mm_add_epi32(accHi, rounding), k_weightBits + k_fracBits);
+		const __m128i packed = _mm_packs_epi32(accLo, accHi);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(packed, packed));
+	}
+
+	if (x < numValues) {
+		std::vector<const int16_t*> tailRows(rows, rows + count);
+		for (auto& row : tailRows)
+			row += x;
+		BlendRowsScalar(tailRows.data(), weights, count, dst + x, numValues - x);
+	}
+}
+
+
+TARGET_AVX2 void BlendRowsAvx2(const int16_t* const* rows, const int16_t* weights, int count, uint8_t* dst, int numValues)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i rounding = _mm256_set1_epi32(1 << (k_weightBits + k_fracBits - 1));
+	int x = 0;
+	for (; x + 16 <= numValues; x += 16) {
+		// unpacking and packing both work within 128-bit lanes, so the order comes out right
+		__m256i accLo = _mm256_setzero_si256();
+		__m256i accHi = _mm256_setzero_si256();
+		for (int k = 0; k < count; k += 2) {
+			const bool hasPair = k + 1 < count;
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + x));
+			const __m256i b = hasPair ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k + 1] + x)) : zero;
+			const int16_t wb = hasPair ? weights[k + 1] : 0;
+			const __m256i w = _mm256_set1_epi32((static_cast<int>(wb) << 16) | static_cast<uint16_t>(weights[k]));
+			accLo = _mm256_add_epi32(accLo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+			accHi = _mm256_add_epi32(accHi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+		}
+		accLo = _mm256_srai_epi32(_mm256_add_epi32(accLo, rounding), k_weightBits + k_fracBits);
+		accHi = _mm256_srai_epi32(_mm256_add_epi32(accHi, rounding), k_weightBits + k_fracBits);
+		const __m256i packed16 = _mm256_packs_epi32(accLo, accHi);
+		const __m256i packed8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(packed16, packed16), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(packed8));
+	}
+
+	if (x < numValues) {
+		std::vector<const int16_t*> tailRows(rows, rows + count);
+		for (auto& row : tailRows)
+			row += x;
+		BlendRowsSse2(tailRows.data(), weights, count, dst + x, numValues - x);
+	}
+}
+
+#endif  // SEKVYU_X86
+
+
+ImageScaler::SimdLevel DetectSimdLevel()
+{
+#ifdef SEKVYU_X86
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool hasSse2 = (info[3] & (1 << 26)) != 0;
+		const bool hasOsAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;  // OSXSAVE, AVX, YMM state
+		bool hasAvx2 = false;
+		if (maxLeaf >= 7) {
+			__cpuidex(info, 7, 0);
+			hasAvx2 = hasOsAvx && (info[1] & (1 << 5)) != 0;
+		}
+	#else
+		__builtin_cpu_init();
+		const bool hasSse2 = __builtin_cpu_supports("sse2") != 0;
+		const bool hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+	#endif  // _MSC_VER
+
+	if (hasAvx2)
+		return ImageScaler::SimdLevel::Avx2;
+	else if (hasSse2)
+		return ImageScaler::SimdLevel::Sse2;
+#endif  // SEKVYU_X86
+	return ImageScaler::SimdLevel::None;
+}
+
+
+// output rows [rowBegin, rowEnd); horizontally scaled source rows are kept in a small ring buffer
+// as consecutive output rows share at most one source row
+void ScaleBand(const uint8_t* srcBits, int srcStride, uint8_t* dstBits, int dstStride, int dstWidth, const Contributions& horz, const Contributions& vert, int rowBegin, int rowEnd, RowScaler scaleRow, RowBlender blendRows)
+{
+	const int numValues = dstWidth * 4;
+	const int ringSize = vert.maxCount;
+	std::vector<int16_t> ring(static_cast<size_t>(ringSize) * numValues);
+	std::vector<const int16_t*> rows(ringSize);
+
+	int lastRow = -1;
+	for (int y = rowBegin; y < rowEnd; ++y) {
+		const int first = vert.first[y];
+		const int count = vert.count[y];
+		for (int k = 0; k < count; ++k) {
+			const int row = first + k;
+			int16_t* slot = ring.data() + static_cast<size_t>(row % ringSize) * numValues;
+			if (row > lastRow) {
+				scaleRow(reinterpret_cast<const uint32_t*>(srcBits + static_cast<size_t>(row) * srcStride), slot, horz);
+				lastRow = row;
+			}
+			rows[k] = slot;
+		}
+		blendRows(rows.data(), vert.weights.data() + vert.offset[y], count, dstBits + static_cast<size_t>(y) * dstStride, numValues);
+	}
+}
+
+
+}  // unnamed namespace
+
+
+
+QImage ImageScaler::Scale(const QImage& image, const QSize& size)
+{
+	TRACE_SCOPE("ImageScaler::Scale");
+
+	if (image.isNull() || size.isEmpty())
+		return QImage();
+
+	const QSize fitted = image.size().scaled(size, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+	const bool isFormatSupported = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32_Premultiplied;
+	const bool isDownscaling = fitted.width() <= image.width() && fitted.height() <= image.height();
+	if (!isFormatSupported || !isDownscaling)
+		return image.scaled(fitted, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	return Downscale(image, fitted, GetSimdLevel());
+}
+
+
+QImage ImageScaler::Downscale(const QImage& image, const QSize& size, SimdLevel level)
+{
+	if (image.isNull() || size.isEmpty())
+		return QImage();
+	else if (size.width() > image.width() || size.height() > image.height())
+		return image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	else if (size == image.size())
+		return image;
+
+	// averaging is only correct on premultiplied colors
+	const bool isFormatSupported = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32_Premultiplied;
+	const QImage src = isFormatSupported ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+	RowScaler scaleRow = ScaleRowScalar;
+	RowBlender blendRows = BlendRowsScalar;
+#ifdef SEKVYU_X86
+	level = std::min(level, GetSimdLevel());
+	if (level == SimdLevel::Avx2) {
+		scaleRow = ScaleRowAvx2;
+		blendRows = BlendRowsAvx2;
+	}
+	else if (level == SimdLevel::Sse2) {
+		scaleRow = ScaleRowSse2;
+		blendRows = BlendRowsSse2;
+	}
+#endif  // SEKVYU_X86
+
+	const auto horz = CalcContributions(src.width(), size.width());
+	const auto vert = CalcContributions(src.height(), size.height());
+
+	QImage dst = SecureArena::CreateImage(size, src.format());
+	if (dst.isNull())
+		return QImage();  // out of memory
+
+	// bits() detaches, which must not happen concurrently in the bands
+	const uint8_t* srcBits = src.constBits();
+	uint8_t* dstBits = dst.bits();
+	const int srcStride = src.bytesPerLine();
+	const int dstStride = dst.bytesPerLine();
+	auto scaleBand = [&](int rowBegin, int rowEnd) {
+		ScaleBand(srcBits, srcStride, dstBits, dstStride, size.width(), horz, vert, rowBegin, rowEnd, scaleRow, blendRows);
+	};
+
+	// bands are taken by idle workers, and by this thread, which may itself be one of them
+	auto& scheduler = TaskScheduler::GetInstance();
+	const int numBands = std::max(1, std::min(static_cast<int>(scheduler.GetWorkerCount()), size.height() / k_minRowsPerBand));
+	scheduler.RunParallel(numBands, [&scaleBand, &size, numBands](int band) {
+		scaleBand(size.height() * band / numBands, size.height() * (band + 1) / numBands);
+	} );
+
+	return dst;
+}
+
+
+ImageScaler::SimdLevel ImageScaler::GetSimdLevel()
+{
+	static const SimdLevel s_level = DetectSimdLevel();
+	return s_level;
+}
@@ -0,0 +1,50 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGESCALER_H
+#define IMAGESCALER_H
+
+#include <QImage>
+#include <QSize>
+
+
+
+// Area-averaging (box filter) downscaler for 32-bit RGB/ARGB images with SSE2 and AVX2 code paths
+// chosen at runtime. Large images are split into row bands which are scaled in parallel.
+class ImageScaler
+{
+public:
+	enum class SimdLevel
+	{
+		None,
+		Sse2,
+		Avx2
+	};
+
+	// fits image into size keeping its aspect ratio; falls back to Qt for upscaling and other formats
+	static QImage Scale(const QImage& image, const QSize& size);
+
+	// same as above but with an exact output size and a forced code path, for comparison purposes
+	static QImage Downscale(const QImage& image, const QSize& size, SimdLevel level);
+
+	static SimdLevel GetSimdLevel();
+};
+
+
+
+#endif // IMAGESCALER_H
@@ -17,8 +17,13 @@
  */
 
 #include "mainwindow.h"
+#include "trace.h"
 
-#include <windows.h>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/resource.h>
+#endif  // _WIN32
 
 #include <QApplication>
 
@@ -27,6 +32,8 @@
 namespace {
 
 
+#ifdef _WIN32
+
 bool EnablePrivilege(const wchar_t* name)
 {
 	HANDLE handle;
@@ -46,6 +53,21 @@ bool EnablePrivilege(const wchar_t* name)
 	return AdjustTokenPrivileges(hToken.get(), false, &tokenPriv, sizeof(tokenPriv), nullptr, nullptr) != FALSE;
 }
 
+#else
+
+// the counterpart of SE_INC_WORKING_SET_NAME: how much an unprivileged process may mlock()
+bool RaiseMemoryLockLimit()
+{
+	rlimit limit;
+	if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0)
+		return false;
+
+	limit.rlim_cur = limit.rlim_max;
+	return setrlimit(RLIMIT_MEMLOCK, &limit) == 0;
+}
+
+#endif  // _WIN32
+
 
 }  // unnamed namespace
 
@@ -53,11 +75,22 @@ bool EnablePrivilege(const wchar_t* name)
 
 int main(int argc, char* argv[])
 {
+#ifdef _WIN32
 	EnablePrivilege(SE_INC_WORKING_SET_NAME);
-
-	QApplication a(argc, argv);
-	MainWindow w;
-	w.show();
-
-	return a.exec();
+#else
+	RaiseMemoryLockLimit();
+#endif  // _WIN32
+
+	Trace::Initialize();
+
+	int exitCode;
+	{
+		QApplication a(argc, argv);
+		MainWindow w;
+		w.show();
+		exitCode = a.exec();
+	}  // background tasks are done once the window is gone
+
+	Trace::Finish();
+	return exitCode;
 }
@@ -20,22 +20,28 @@
 
 #include <algorithm>
 #include <array>
+#include <cwctype>
 #include <limits>
 
+#include <QActionGroup>
 #include <QCoreApplication>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QGridLayout>
+#include <QImageReader>
 #include <QInputDialog>
 #include <QKeyEvent>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QSettings>
 #include <QSpacerItem>
+#include <QStatusBar>
 #include <QString>
+#include <QTimer>
+#include <QtConcurrent>
 
 // Extract7Z
 #include <Buffer.h>
-#include <Password.h>
 
 #include "fileformat.h"
 #include "git.h"
@@ -46,6 +52,10 @@
 namespace {
 
 
+constexpr int k_passwordPurgeIntervalMsec = 60 * 1000;
+constexpr int k_maxPasswordAttempts = 3;  // typed ones; a damaged archive looks like a wrong password
+
+
 template <typename T>
 constexpr const T& Clamp(const T& v, const T& lo, const T& hi)
 {
@@ -57,6 +67,8 @@ QString GetArchiveOpenErrorMsg(Archive::OpenResult result)
 {
 	if (result == Archive::OpenResult::DllNotFound)
 		return "Failed to load 7z.dll.";
+	else if (result == Archive::OpenResult::WrongPassword)
+		return "The password is incorrect, or the archive is damaged.";
 	else if (result == Archive::OpenResult::ExtractionError)
 		return "Failed to open the archive.";
 	else
@@ -85,6 +97,40 @@ bool TranslateToNavigationKey(int key, ArchiveImageView::Rotation& rotation)
 }
 
 
+// entries which are certainly not images are rejected by name, whatever their first bytes look like
+bool HasNonImageExtension(const std::wstring& name)
+{
+	static const std::array<const wchar_t*, 16> nonImageExts = {{
+		L".txt", L".nfo", L".htm", L".html", L".xml", L".pdf", L".epub", L".doc",
+		L".mp3", L".mp4", L".mkv", L".avi", L".webm", L".zip", L".rar", L".exe"
+	}};
+
+	auto dotPos = name.find_last_of(L'.');
+	if (dotPos == std::wstring::npos)
+		return false;
+	auto ext = name.substr(dotPos);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); } );
+	return std::any_of(nonImageExts.cbegin(), nonImageExts.cend(), [&ext](const wchar_t* nonImageExt) { return ext == nonImageExt; } );
+}
+
+
+// whether Qt has a plugin for it; AVIF, HEIF and JPEG XL need third-party ones
+bool IsDecodable(FileFormat::Type fileType)
+{
+	static const auto supportedFormats = QImageReader::supportedImageFormats();
+	const char* format = FileFormat::GetQtFormat(fileType);
+	return format != nullptr && supportedFormats.contains(format);
+}
+
+
+bool IsSupportedImage(const FileRecord& frec, FileFormat::Type fileType)
+{
+	if (!frec.data || frec.data->GetSize() == 0 || HasNonImageExtension(frec.name))
+		return false;
+	return IsDecodable(fileType);
+}
+
+
 QSettings& GetSettings()
 {
 	static QSettings settings("debug", "Sekvyu");
@@ -101,17 +147,63 @@ MainWindow::MainWindow(QWidget *parent)
 	, m_ui(new Ui::MainWindow)
 	, m_flagFirstTimeShown(true)
 	, m_archive()
+	, m_pendingLoad()
+	, m_loadProgress(new QProgressBar(this))
+	, m_loadCancelButton(new QPushButton("Cancel", this))
+	, m_thumbnailDock(new QDockWidget("Thumbnails", this))
+	, m_thumbnailView(new ThumbnailView(m_thumbnailDock))
+	, m_passwordCache(std::make_shared<PasswordCache>())
 {
 	m_ui->setupUi(this);
 
+	m_thumbnailDock->setObjectName("thumbnailDock");  // for saveState()
+	m_thumbnailDock->setWidget(m_thumbnailView);
+	m_thumbnailDock->hide();
+	addDockWidget(Qt::LeftDockWidgetArea, m_thumbnailDock);
+	auto toggleThumbnails = m_thumbnailDock->toggleViewAction();
+	toggleThumbnails->setText("&Thumbnails");
+	toggleThumbnails->setShortcut(QKeySequence("Ctrl+T"));
+	m_ui->menuView->addAction(toggleThumbnails);
+
+	auto viewModes = new QActionGroup(this);
+	viewModes->addAction(m_ui->actionSinglePage);
+	viewModes->addAction(m_ui->actionTwoPageSpread);
+	viewModes->addAction(m_ui->actionContinuousScroll);
+
 	auto& settings = GetSettings();
 	restoreGeometry(settings.value("geometry").toByteArray());
+	restoreState(settings.value("windowState").toByteArray());
+	const int viewMode = settings.value("viewMode", 0).toInt();
+	m_ui->actionTwoPageSpread->setChecked(viewMode == static_cast<int>(ArchiveImageView::ViewMode::TwoPageSpread));
+	m_ui->actionContinuousScroll->setChecked(viewMode == static_cast<int>(ArchiveImageView::ViewMode::ContinuousScroll));
+	m_ui->actionRightToLeft->setChecked(settings.value("rightToLeft", false).toBool());
+	m_ui->actionCoverPage->setChecked(settings.value("coverPage", false).toBool());
+	applyViewMode();
+
+	// Extractor7Z reports no progress, so the bar only shows that something is going on
+	m_loadProgress->setRange(0, 0);
+	m_loadProgress->setMaximumWidth(150);
+	statusBar()->addPermanentWidget(m_loadProgress);
+	statusBar()->addPermanentWidget(m_loadCancelButton);
+	statusBar()->hide();
 
 	QObject::connect(this, &MainWindow::sigOpenFile, this, &MainWindow::loadArchive);
+	QObject::connect(m_loadCancelButton, &QPushButton::clicked, this, &MainWindow::cancelLoading);
+	QObject::connect(m_thumbnailView, &ThumbnailView::pageActivated, this, &MainWindow::onPageActivated);
+	QObject::connect(m_ui->imageView, &ArchiveImageView::indexChanged, m_thumbnailView, &ThumbnailView::setCurrentPage);
+	QObject::connect(m_ui->imageView, &ArchiveImageView::indexChanged, this, &MainWindow::refreshWindowTitle);  // scrolling changes pages too
+	QObject::connect(viewModes, &QActionGroup::triggered, this, &MainWindow::applyViewMode);
+	QObject::connect(m_ui->actionRightToLeft, &QAction::toggled, this, &MainWindow::applyViewMode);
+	QObject::connect(m_ui->actionCoverPage, &QAction::toggled, this, &MainWindow::applyViewMode);
+
+	auto passwordPurgeTimer = new QTimer(this);
+	QObject::connect(passwordPurgeTimer, &QTimer::timeout, this, [this]() { m_passwordCache->PurgeExpired(); } );
+	passwordPurgeTimer->start(k_passwordPurgeIntervalMsec);
 }
 
 MainWindow::~MainWindow()
 {
+	cancelLoading();  // after which the worker no longer calls back
 	delete m_ui;
 }
 
@@ -120,8 +212,17 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 {
 	QWidget::keyPressEvent(event);
 
+	if (event->key() == Qt::Key_Escape) {
+		cancelLoading();
+		return;
+	}
+
 	ArchiveImageView::Rotation rotation;
 	if (TranslateToNavigationKey(event->key(), rotation)) {
+		// the next spread of a right-to-left book is to the left
+		const bool isArrowKey = event->key() == Qt::Key_Left || event->key() == Qt::Key_Right;
+		if (isArrowKey && m_ui->actionRightToLeft->isEnabled() && m_ui->actionRightToLeft->isChecked())
+			rotation = rotation == ArchiveImageView::Rotation::Next ? ArchiveImageView::Rotation::Previous : ArchiveImageView::Rotation::Next;
 		m_ui->imageView->rotate(rotation);
 		refreshWindowTitle();
 	}
@@ -168,8 +269,14 @@ void MainWindow::dropEvent(QDropEvent* event)
 
 void MainWindow::closeEvent(QCloseEvent* event)
 {
+	cancelLoading();  // a cancelled extraction finishes by itself without the window
+
 	auto& settings = GetSettings();
 	settings.setValue("geometry", saveGeometry());
+	settings.setValue("windowState", saveState());
+	settings.setValue("viewMode", static_cast<int>(m_ui->imageView->getViewMode()));
+	settings.setValue("rightToLeft", m_ui->actionRightToLeft->isChecked());
+	settings.setValue("coverPage", m_ui->actionCoverPage->isChecked());
 	QMainWindow::closeEvent(event);
 }
 
@@ -214,42 +321,199 @@ void MainWindow::loadArchive(const QString& filePath)
 {
 	if (m_archive && m_archive->GetPath() == filePath)
 		return;
+	cancelLoading();  // a newer request supersedes the one in progress
+
+	auto load = std::make_shared<PendingLoad>();
+
+	// The password prompt is requested from the worker thread but must be shown on the GUI thread.
+	// It is posted under the lock which cancelLoading() takes, so once a load is cancelled, as it is
+	// before the window goes away, the worker never touches the window again.
+	auto askPassword = [this, load](std::wstring& outPasswd, bool isRetry) {
+		QString passwd;
+		{
+			std::unique_lock<std::mutex> lock(load->mutex);
+			if (!load->isCancelled) {
+				load->isAnswered = false;
+				QMetaObject::invokeMethod(this, [this, load, isRetry]() {
+					if (load->isCancelled)
+						return;
+					bool isOkPressed = false;
+					const char* label = isRetry ? "Wrong password, or the archive is damaged. Please try again." : "Enter Password";
+					QString entered = QInputDialog::getText(this, "Password", label, QLineEdit::Password, QString(), &isOkPressed);
+					if (!isOkPressed) {
+						cancelLoading();  // wakes the worker as well
+						return;
+					}
+					{
+						std::lock_guard<std::mutex> answerLock(load->mutex);
+						load->password.swap(entered);
+						load->isAnswered = true;
+					}
+					load->answered.notify_all();
+				}, Qt::QueuedConnection);
+				load->answered.wait(lock, [&load]() { return load->isAnswered || load->isCancelled; });
+				passwd.swap(load->password);
+			}
+		}
+		// the swap leaves the previous contents of outPasswd in the temporary, so both get wiped
+		auto widePasswd = passwd.toStdWString();
+		outPasswd.swap(widePasswd);
+		SecureArena::Wipe(&widePasswd[0], widePasswd.size() * sizeof(wchar_t));
+		SecureArena::Wipe(passwd.data(), passwd.size() * sizeof(QChar));
+	};
+
+	// extraction and filtering based on file type, both off the GUI thread
+	auto newArchive = std::make_shared<Archive>();
+	auto passwordCache = m_passwordCache;
+	auto future = QtConcurrent::run( [newArchive, filePath, askPassword, load, passwordCache]() -> Archive::OpenResult {
+		// volumes of a series usually sit in the same folder and share one password
+		const auto& passwdKey = QFileInfo(filePath).absolutePath();
+		bool isCachedPasswdUsed = false;
+		bool isRetry = false;
+		PasswordCache::SecureString enteredPasswd;
+		auto getPassword = [&](std::wstring& outPasswd) -> bool {
+			// outPasswd belongs to Extract7Z; the only other copy is in the arena and wiped on release
+			PasswordCache::SecureString cachedPasswd;
+			isCachedPasswdUsed = passwordCache->Lookup(passwdKey, cachedPasswd);
+			if (isCachedPasswdUsed) {
+				outPasswd.assign(cachedPasswd.cbegin(), cachedPasswd.cend());
+			}
+			else {
+				askPassword(outPasswd, isRetry);
+				enteredPasswd.assign(outPasswd.cbegin(), outPasswd.cend());  // stored only if still remembering by then
+			}
+			return true;  // never ask again
+		};
+
+		// Ask again until the password fits, the user gives up, which cancels the loading, or enough
+		// typed passwords have failed that the archive is more likely damaged.
+		int numTypedAttempts = 0;
+		auto result = newArchive->Open(filePath, getPassword, IsSupportedImage);
+		while (result == Archive::OpenResult::WrongPassword && !load->isCancelled) {
+			if (isCachedPasswdUsed)
+				passwordCache->Forget(passwdKey);  // may belong to another archive in the folder
+			else if (++numTypedAttempts >= k_maxPasswordAttempts)
+				break;
+			else
+				isRetry = true;
+			result = newArchive->Open(filePath, getPassword, IsSupportedImage);
+		}
 
-	// extraction
-	Password password( [this](std::wstring& outPasswd) -> bool {
-		auto passwd = QInputDialog::getText(this, "Password", "Enter Password", QLineEdit::Password);
-		outPasswd = reinterpret_cast<const wchar_t*>(passwd.utf16());
-		return true;  // never ask again
+		if (load->isCancelled)
+			*newArchive = Archive();  // release extracted data right away
+		else if (result == Archive::OpenResult::Success && !enteredPasswd.empty())
+			passwordCache->Store(passwdKey, enteredPasswd);
+		return result;
 	} );
-	auto newArchive = std::make_shared<Archive>();
-	auto result = newArchive->Open(filePath, password);
-	if (result != Archive::OpenResult::Success) {
-		showError(GetArchiveOpenErrorMsg(result));
+
+	auto watcher = new QFutureWatcher<Archive::OpenResult>(this);
+	QObject::connect(watcher, &QFutureWatcher<Archive::OpenResult>::finished, this, [this, watcher, newArchive, load]() mutable {
+		watcher->deleteLater();
+		if (!load->isCancelled)
+			onArchiveLoaded(newArchive, watcher->result());
+		newArchive.reset();
+	} );
+	watcher->setFuture(future);
+	m_pendingLoad = load;
+
+	if (!m_archive)
+		m_ui->imageView->setPending("Opening archive...");
+	setLoadingIndicator(QFileInfo(filePath).fileName());
+}
+
+
+// Extractor7Z cannot be interrupted, so a cancelled extraction runs on but its result is discarded
+void MainWindow::cancelLoading()
+{
+	if (!m_pendingLoad)
 		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_pendingLoad->mutex);
+		m_pendingLoad->isCancelled = true;
 	}
+	m_pendingLoad->answered.notify_all();
+	m_pendingLoad.reset();
 
-	// filter based on file type
-	newArchive->Filter( [](const FileRecord& frec) -> bool {
-		auto fileSize = frec.data->GetSize();
-		if (fileSize == 0)
-			return false;
-		auto fileType = FileFormat::GetType(frec.data->GetData(), fileSize);
-		return fileType == FileFormat::Type::Jpeg || fileType == FileFormat::Type::Png;
-	} );
-	if (newArchive->GetFileCount() == 0) {
-		showError("The archive does not contain any valid image.");
+	if (!m_archive)
+		m_ui->imageView->setPending(QString());
+	setLoadingIndicator(QString());
+}
+
+
+void MainWindow::onPageActivated(size_t index)
+{
+	m_ui->imageView->setIndex(index);
+	refreshWindowTitle();
+	m_ui->imageView->setFocus();  // keep navigation keys going to the window
+}
+
+
+// remembered passwords are wiped as soon as this is turned off
+void MainWindow::setPasswordRemembering(bool isEnabled)
+{
+	m_passwordCache->SetEnabled(isEnabled);
+}
+
+
+// from the View menu, whose mode actions are exclusive
+void MainWindow::applyViewMode()
+{
+	auto mode = ArchiveImageView::ViewMode::SinglePage;
+	if (m_ui->actionTwoPageSpread->isChecked())
+		mode = ArchiveImageView::ViewMode::TwoPageSpread;
+	else if (m_ui->actionContinuousScroll->isChecked())
+		mode = ArchiveImageView::ViewMode::ContinuousScroll;
+
+	m_ui->actionRightToLeft->setEnabled(mode == ArchiveImageView::ViewMode::TwoPageSpread);
+	m_ui->actionCoverPage->setEnabled(mode == ArchiveImageView::ViewMode::TwoPageSpread);
+	m_ui->imageView->setSpreadOptions(m_ui->actionRightToLeft->isChecked(), m_ui->actionCoverPage->isChecked());
+	m_ui->imageView->setViewMode(mode);
+	refreshWindowTitle();
+}
+
+
+void MainWindow::onArchiveLoaded(std::shared_ptr<Archive>& newArchive, Archive::OpenResult result)
+{
+	m_pendingLoad.reset();
+	setLoadingIndicator(QString());
+
+	if (result != Archive::OpenResult::Success || newArchive->GetFileCount() == 0) {
+		if (!m_archive)
+			m_ui->imageView->setPending(QString());
+		showError(result != Archive::OpenResult::Success ? GetArchiveOpenErrorMsg(result) : "The archive does not contain any valid image.");
 		return;
 	}
 
 	m_archive = std::move(newArchive);
+	m_thumbnailView->setArchive(m_archive);
 	m_ui->imageView->setArchive(m_archive);
 	m_ui->actionSaveImageAs->setEnabled(true);
 	m_ui->actionGoTo->setEnabled(true);
+	m_ui->actionZoomIn->setEnabled(true);
+	m_ui->actionZoomOut->setEnabled(true);
+	m_ui->actionFitToWindow->setEnabled(true);
 
 	refreshWindowTitle();
 }
 
 
+// an empty name hides the indicator
+void MainWindow::setLoadingIndicator(const QString& fileName)
+{
+	if (fileName.isEmpty()) {
+		statusBar()->clearMessage();
+		statusBar()->hide();
+		refreshWindowTitle();
+	}
+	else {
+		statusBar()->showMessage(QString("Opening %1...").arg(fileName));
+		statusBar()->show();
+		setWindowTitle(QString("Opening %1... - Sekvyu").arg(fileName));
+	}
+}
+
+
 void MainWindow::showImgCtxMenu(const QPoint&)
 {
 	if (!m_archive || m_archive->GetFileCount() == 0)
@@ -267,10 +531,7 @@ bool MainWindow::saveCurrentImg()
 		return false;
 
 	auto currIndex = m_ui->imageView->getCurrentIndex();
-	const auto& fileRecord = m_archive->GetContent().at(currIndex);
-
-	auto&& inArchiveName = QString::fromUtf16(reinterpret_cast<const ushort*>(fileRecord.name.c_str()));
-	auto&& defaultName = QFileInfo(inArchiveName).fileName();
+	auto&& defaultName = QFileInfo(m_archive->GetFileName(currIndex)).fileName();
 	auto&& filePath = QFileDialog::getSaveFileName(this, "Save Image", m_archive->GetLastSavedDir() + defaultName);
 	if (filePath.length() == 0)
 		return false;
@@ -311,12 +572,13 @@ void MainWindow::showAbout()
 
 void MainWindow::refreshWindowTitle()
 {
-	if (!m_archive)
+	if (!m_archive) {
+		setWindowTitle("Sekvyu");
 		return;
+	}
 
 	auto currIndex = m_ui->imageView->getCurrentIndex();
-	const auto& fileRecord = m_archive->GetContent().at(currIndex);
-	const auto fileName = reinterpret_cast<const ushort*>(fileRecord.name.c_str());
+	const auto& fileName = m_archive->GetFileName(currIndex);
 	const auto& title = QString("%1 [%2] (%3/%4) - Sekvyu")
 		.arg(m_archive->GetName())
 		.arg(fileName)
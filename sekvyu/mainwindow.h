@@ -19,13 +19,21 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 
+#include <QDockWidget>
 #include <QMainWindow>
 #include <QPixmap>
+#include <QProgressBar>
+#include <QPushButton>
 
 #include "archive.h"
 #include "archiveimageview.h"
+#include "passwordcache.h"
+#include "thumbnailview.h"
 
 
 namespace Ui {
@@ -51,6 +59,8 @@ public slots:
 	void askOpenFile();
 	void askImageIndex();
 	void loadArchive(const QString& filePath);
+	void cancelLoading();
+	void setPasswordRemembering(bool isEnabled);
 	void showImgCtxMenu(const QPoint& cursorPos);
 	bool saveCurrentImg();
 	void showAbout();
@@ -63,13 +73,34 @@ private:
 	virtual void dropEvent(QDropEvent* event) override;
 	virtual void closeEvent(QCloseEvent* event) override;
 
+	void onPageActivated(size_t index);
+	void applyViewMode();
+	void onArchiveLoaded(std::shared_ptr<Archive>& newArchive, Archive::OpenResult result);
+	void setLoadingIndicator(const QString& fileName);
 	void refreshWindowTitle();
 	void showError(const QString& msg);
 
 
+	// what the window shares with a worker opening an archive, which may run on after the window is gone
+	struct PendingLoad
+	{
+		std::mutex mutex;
+		std::condition_variable answered;  // a password was entered or the load was cancelled
+		std::atomic<bool> isCancelled{ false };  // set under the mutex
+		bool isAnswered = false;
+		QString password;
+	};
+
+
 	Ui::MainWindow* m_ui;
 	bool m_flagFirstTimeShown;
 	std::shared_ptr<Archive> m_archive;
+	std::shared_ptr<PendingLoad> m_pendingLoad;  // of the archive being opened; null if none
+	QProgressBar* m_loadProgress;
+	QPushButton* m_loadCancelButton;
+	QDockWidget* m_thumbnailDock;
+	ThumbnailView* m_thumbnailView;
+	std::shared_ptr<PasswordCache> m_passwordCache;  // only filled while remembering is enabled
 };
 
 
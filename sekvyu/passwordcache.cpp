@@ -0,0 +1,104 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "passwordcache.h"
+
+
+
+namespace {
+
+
+constexpr auto k_idleLifetime = std::chrono::minutes(15);
+
+
+}  // unnamed namespace
+
+
+
+PasswordCache::PasswordCache()
+	: m_mutex()
+	, m_isEnabled(false)
+	, m_entries()
+{
+}
+
+PasswordCache::~PasswordCache()
+{
+	Clear();
+}
+
+
+// checked under the same lock as Store, so a load finishing after remembering was turned off stores nothing
+void PasswordCache::SetEnabled(bool isEnabled)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isEnabled = isEnabled;
+	if (!isEnabled)
+		m_entries.clear();
+}
+
+
+void PasswordCache::Store(const QString& key, const SecureString& password)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_isEnabled)
+		return;
+	auto& entry = m_entries[key];
+	entry.password = password;
+	entry.lastUsed = Clock::now();
+}
+
+
+bool PasswordCache::Lookup(const QString& key, SecureString& outPassword)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto itr = m_entries.find(key);
+	if (itr == m_entries.end())
+		return false;
+
+	outPassword = itr->second.password;
+	itr->second.lastUsed = Clock::now();
+	return true;
+}
+
+
+void PasswordCache::Forget(const QString& key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.erase(key);  // SecureAllocator wipes the password
+}
+
+
+void PasswordCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+
+void PasswordCache::PurgeExpired()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const auto& expiry = Clock::now() - k_idleLifetime;
+	for (auto itr = m_entries.begin(); itr != m_entries.end(); ) {
+		if (itr->second.lastUsed < expiry)
+			itr = m_entries.erase(itr);
+		else
+			++itr;
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PASSWORDCACHE_H
+#define PASSWORDCACHE_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <QString>
+
+#include "securearena.h"
+
+
+
+// Passwords of recently opened archives, kept in the secure arena for the rest of the session if
+// the user asks for it. Entries are wiped once they have gone unused for a while, or all at once when
+// remembering is disabled, after which nothing is stored or found until it is enabled again. Methods
+// may be called from any thread.
+class PasswordCache
+{
+public:
+	using SecureString = std::vector<wchar_t, SecureAllocator<wchar_t>>;  // no small-string buffer outside the arena
+
+
+	PasswordCache();
+	~PasswordCache();
+
+	void SetEnabled(bool isEnabled);
+	void Store(const QString& key, const SecureString& password);  // no-op while disabled
+	bool Lookup(const QString& key, SecureString& outPassword);  // never into memory outside the arena
+	void Forget(const QString& key);
+	void Clear();
+	void PurgeExpired();
+
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry
+	{
+		SecureString password;
+		Clock::time_point lastUsed;
+	};
+
+
+	std::mutex m_mutex;
+	bool m_isEnabled;
+	std::map<QString, Entry> m_entries;
+};
+
+
+
+#endif // PASSWORDCACHE_H
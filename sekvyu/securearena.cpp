@@ -0,0 +1,389 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define NOMINMAX
+
+#include "securearena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif  // _WIN32
+
+
+
+namespace {
+
+
+constexpr size_t k_blockAlignment = 64;  // cache line
+constexpr size_t k_chunkSize = 8 * 1024 * 1024;  // granularity of locking
+constexpr size_t k_hugePageSize = 2 * 1024 * 1024;
+
+
+inline size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+
+void WipeMemory(void* ptr, size_t size)
+{
+#if defined(_WIN32)
+	SecureZeroMemory(ptr, size);
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+	explicit_bzero(ptr, size);
+#else
+	// a word at a time in between the unaligned ends
+	auto bytes = static_cast<volatile uint8_t*>(ptr);
+	auto end = bytes + size;
+	while (bytes < end && reinterpret_cast<uintptr_t>(bytes) % sizeof(uintptr_t) != 0)
+		*bytes++ = 0;
+	for (auto words = reinterpret_cast<volatile uintptr_t*>(bytes); end - bytes >= static_cast<ptrdiff_t>(sizeof(uintptr_t)); ++words) {
+		*words = 0;
+		bytes += sizeof(uintptr_t);
+	}
+	while (bytes < end)
+		*bytes++ = 0;
+#endif
+}
+
+
+void FreeImageData(void* info)
+{
+	SecureArena::GetInstance().Free(info);
+}
+
+
+}  // unnamed namespace
+
+
+
+SecureArena& SecureArena::GetInstance()
+{
+	static SecureArena s_instance;
+	return s_instance;
+}
+
+
+SecureArena::SecureArena()
+	: m_mutex()
+	, m_base(nullptr)
+	, m_capacity(0)
+	, m_maxCapacity(0)
+	, m_reservedSize(0)
+	, m_reservedBase(nullptr)
+	, m_freeBlocks()
+	, m_usedBlocks()
+	, m_committedChunks()
+	, m_lockedChunks()
+{
+}
+
+SecureArena::~SecureArena()
+{
+	if (m_reservedBase == nullptr)
+		return;
+
+	// untouched chunks are not wiped, which would commit them only to be released
+	for (size_t chunk = 0; chunk < m_committedChunks.size(); ++chunk) {
+		if (m_committedChunks[chunk])
+			WipeMemory(m_base + chunk * k_chunkSize, k_chunkSize);
+	}
+#ifdef _WIN32
+	VirtualFree(m_reservedBase, 0, MEM_RELEASE);
+#else
+	munmap(m_reservedBase, m_reservedSize);
+#endif  // _WIN32
+}
+
+
+bool SecureArena::Reserve(size_t maxCapacity, bool useHugePages)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_reservedBase != nullptr || maxCapacity == 0)
+			return false;
+
+		size_t capacity = maxCapacity;
+
+		capacity = AlignUp(capacity, k_chunkSize);
+#ifdef _WIN32
+		// large pages would need SeLockMemoryPrivilege and can never be paged out, so they are not used
+		(void)useHugePages;
+		m_reservedSize = capacity;
+		m_reservedBase = static_cast<uint8_t*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE, PAGE_READWRITE));
+		if (m_reservedBase == nullptr)
+			return false;
+		m_base = m_reservedBase;
+#else
+		// over-reserve so that the base can be aligned for transparent huge pages
+		m_reservedSize = capacity + k_hugePageSize;
+		void* region = mmap(nullptr, m_reservedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (region == MAP_FAILED) {
+			m_reservedBase = nullptr;
+			return false;
+		}
+		m_reservedBase = static_cast<uint8_t*>(region);
+		m_base = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uintptr_t>(m_reservedBase), k_hugePageSize));
+
+	#ifdef MADV_DONTDUMP
+		madvise(m_base, capacity, MADV_DONTDUMP);
+	#endif  // MADV_DONTDUMP
+	#ifdef MADV_HUGEPAGE
+		if (useHugePages)
+			madvise(m_base, capacity, MADV_HUGEPAGE);
+	#else
+		(void)useHugePages;
+	#endif  // MADV_HUGEPAGE
+#endif  // _WIN32
+
+		m_capacity = capacity;
+		m_maxCapacity = capacity;
+		m_freeBlocks[0] = capacity;
+		m_committedChunks.assign(capacity / k_chunkSize, false);
+		m_lockedChunks.assign(capacity / k_chunkSize, false);
+	}
+
+	SetWorkingSetSizeHint(0);  // make room for the arena to be locked
+	return true;
+}
+
+
+void SecureArena::Resize(size_t capacity)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_reservedBase == nullptr)
+			return;
+		m_capacity = std::min(AlignUp(std::max<size_t>(capacity, 1), k_chunkSize), m_maxCapacity);
+	}
+
+	SetWorkingSetSizeHint(0);
+}
+
+
+// first fit; blocks are rarely more than a few dozen, one or two per cached image
+void* SecureArena::Allocate(size_t size)
+{
+	if (size == 0)
+		return nullptr;
+	size = AlignUp(size, k_blockAlignment);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const size_t capacity = m_capacity;
+	auto itr = std::find_if(m_freeBlocks.begin(), m_freeBlocks.end(), [size, capacity](const std::pair<const size_t, size_t>& block) {
+		return block.second >= size && block.first + size <= capacity;
+	} );
+	if (itr == m_freeBlocks.end())
+		return nullptr;
+
+	const size_t offset = itr->first;
+	if (!CommitChunks(offset, size))
+		return nullptr;  // the block stays free and the caller falls back to the heap
+
+	const size_t remaining = itr->second - size;
+	m_freeBlocks.erase(itr);
+	if (remaining > 0)
+		m_freeBlocks[offset + size] = remaining;
+	m_usedBlocks[offset] = size;
+
+	LockChunks(offset, size);  // the memory is usable even if locking fails
+	return m_base + offset;
+}
+
+
+// A block is wiped after it has been unlinked and before it is put back, with the arena unlocked,
+// so that freeing a large image does not hold up allocations on other threads.
+bool SecureArena::Free(void* ptr)
+{
+	auto bytePtr = static_cast<uint8_t*>(ptr);
+	size_t offset;
+	size_t size;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_base == nullptr || bytePtr < m_base || bytePtr >= m_base + m_maxCapacity)
+			return false;
+
+		auto used = m_usedBlocks.find(static_cast<size_t>(bytePtr - m_base));
+		if (used == m_usedBlocks.end())
+			return false;
+
+		offset = used->first;
+		size = used->second;
+		m_usedBlocks.erase(used);
+	}
+
+	WipeMemory(bytePtr, size);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// coalesce with neighbouring free blocks
+	auto next = m_freeBlocks.lower_bound(offset);
+	if (next != m_freeBlocks.end() && offset + size == next->first) {
+		size += next->second;
+		next = m_freeBlocks.erase(next);
+	}
+	if (next != m_freeBlocks.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			m_freeBlocks.erase(prev);
+		}
+	}
+	m_freeBlocks[offset] = size;
+	ReleaseChunks(offset, size);
+	return true;
+}
+
+
+bool SecureArena::Contains(const void* ptr) const
+{
+	auto bytePtr = static_cast<const uint8_t*>(ptr);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_base != nullptr && bytePtr >= m_base && bytePtr < m_base + m_maxCapacity;
+}
+
+
+size_t SecureArena::GetCapacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_capacity;
+}
+
+
+// Chunks are committed the first time they are used and stay so until they are empty again. Without
+// a commit the memory is not usable at all on Windows; Linux commits pages as they are touched.
+bool SecureArena::CommitChunks(size_t offset, size_t size)
+{
+	for (size_t chunk = offset / k_chunkSize; chunk <= (offset + size - 1) / k_chunkSize; ++chunk) {
+		if (m_committedChunks[chunk])
+			continue;
+
+#ifdef _WIN32
+		if (VirtualAlloc(m_base + chunk * k_chunkSize, k_chunkSize, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+			return false;  // chunks committed so far stay so and are used by later blocks
+#endif  // _WIN32
+		m_committedChunks[chunk] = true;
+	}
+	return true;
+}
+
+
+// chunks are locked the first time they are used and stay so until released; they must be committed
+bool SecureArena::LockChunks(size_t offset, size_t size)
+{
+	bool isAllLocked = true;
+	for (size_t chunk = offset / k_chunkSize; chunk <= (offset + size - 1) / k_chunkSize; ++chunk) {
+		if (m_lockedChunks[chunk])
+			continue;
+
+		uint8_t* chunkBase = m_base + chunk * k_chunkSize;
+#ifdef _WIN32
+		m_lockedChunks[chunk] = VirtualLock(chunkBase, k_chunkSize) != FALSE;
+#else
+		m_lockedChunks[chunk] = mlock(chunkBase, k_chunkSize) == 0;  // may fail under a low RLIMIT_MEMLOCK
+#endif  // _WIN32
+		isAllLocked = isAllLocked && m_lockedChunks[chunk];
+	}
+	return isAllLocked;
+}
+
+
+// The block has been wiped, so the pages can be dropped as they are. An image freed and another one
+// allocated in its place costs a lock and an unlock per chunk, which is what the arena did at first.
+void SecureArena::ReleaseChunks(size_t offset, size_t size)
+{
+	for (size_t chunk = AlignUp(offset, k_chunkSize) / k_chunkSize; (chunk + 1) * k_chunkSize <= offset + size; ++chunk) {
+		if (!m_committedChunks[chunk])
+			continue;
+
+		uint8_t* chunkBase = m_base + chunk * k_chunkSize;
+#ifdef _WIN32
+		VirtualFree(chunkBase, k_chunkSize, MEM_DECOMMIT);  // which unlocks as well
+#else
+		if (m_lockedChunks[chunk])
+			munlock(chunkBase, k_chunkSize);
+		madvise(chunkBase, k_chunkSize, MADV_DONTNEED);
+#endif  // _WIN32
+		m_committedChunks[chunk] = false;
+		m_lockedChunks[chunk] = false;
+	}
+}
+
+
+QImage SecureArena::CreateImage(const QSize& size, QImage::Format format)
+{
+	const auto bitsPerPixel = QImage::toPixelFormat(format).bitsPerPixel();
+	const int bytesPerLine = static_cast<int>(AlignUp((static_cast<size_t>(size.width()) * bitsPerPixel + 7) / 8, 4));
+	void* data = size.isEmpty() ? nullptr : GetInstance().Allocate(static_cast<size_t>(bytesPerLine) * size.height());
+	if (data == nullptr)
+		return QImage(size, format);
+
+	return QImage(static_cast<uchar*>(data), size.width(), size.height(), bytesPerLine, format, FreeImageData, data);
+}
+
+
+QImage SecureArena::CopyToArena(const QImage& image)
+{
+	if (image.isNull() || GetInstance().Contains(image.constBits()))
+		return image;
+
+	QImage copy = CreateImage(image.size(), image.format());
+	if (copy.isNull())
+		return image;
+
+	const int lineSize = std::min(image.bytesPerLine(), copy.bytesPerLine());
+	for (int y = 0; y < image.height(); ++y)
+		std::memcpy(copy.scanLine(y), image.constScanLine(y), lineSize);
+	copy.setColorTable(image.colorTable());
+	copy.setDevicePixelRatio(image.devicePixelRatio());
+	return copy;
+}
+
+
+// Windows only locks pages up to the minimum working set size; Linux is bound by RLIMIT_MEMLOCK instead
+bool SecureArena::SetWorkingSetSizeHint(size_t sizeHint)
+{
+#ifdef _WIN32
+	sizeHint += GetInstance().GetCapacity();
+
+	HANDLE hProc = GetCurrentProcess();
+	size_t minSize, maxSize;
+	GetProcessWorkingSetSize(hProc, &minSize, &maxSize);
+
+	if (minSize < sizeHint)
+		return SetProcessWorkingSetSize(hProc, sizeHint, std::max(sizeHint, maxSize)) != FALSE;
+	else
+		return true;  // no need to expand
+#else
+	(void)sizeHint;
+	return true;
+#endif  // _WIN32
+}
+
+
+void SecureArena::Wipe(void* ptr, size_t size)
+{
+	WipeMemory(ptr, size);
+}
@@ -0,0 +1,120 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECUREARENA_H
+#define SECUREARENA_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <QImage>
+#include <QSize>
+
+
+
+// One large region of memory, kept out of swap and (on Linux) core dumps, from which decoded images
+// are sub-allocated. Locking is done once per chunk when it is first used instead of once per image,
+// freed blocks are wiped, and chunks left empty are unlocked and given back to the system. Only the
+// capacity currently set is handed out, so the region can be reserved at its largest up front.
+// Allocations fall back to the regular heap when the arena is exhausted.
+class SecureArena
+{
+public:
+	static SecureArena& GetInstance();
+
+	bool Reserve(size_t maxCapacity, bool useHugePages);  // only once, before anything is allocated
+	void Resize(size_t capacity);  // within what was reserved; blocks beyond it stay valid until freed
+	void* Allocate(size_t size);
+	bool Free(void* ptr);  // false if ptr is not from this arena
+	bool Contains(const void* ptr) const;
+
+	size_t GetCapacity() const;
+
+	// images whose pixels live in the arena
+	static QImage CreateImage(const QSize& size, QImage::Format format);
+	static QImage CopyToArena(const QImage& image);  // returns image itself if it is already there
+
+	// sizeHint is what the process needs besides the arena
+	static bool SetWorkingSetSizeHint(size_t sizeHint);
+
+	static void Wipe(void* ptr, size_t size);  // not optimized away
+
+
+private:
+	SecureArena();
+	~SecureArena();
+	SecureArena(const SecureArena&) = delete;
+	SecureArena& operator=(const SecureArena&) = delete;
+
+	bool CommitChunks(size_t offset, size_t size);
+	bool LockChunks(size_t offset, size_t size);
+	void ReleaseChunks(size_t offset, size_t size);  // those lying wholly within the free block
+
+
+	mutable std::mutex m_mutex;
+	uint8_t* m_base;
+	size_t m_capacity;
+	size_t m_maxCapacity;
+	size_t m_reservedSize;  // m_maxCapacity plus alignment slack
+	uint8_t* m_reservedBase;
+	std::map<size_t, size_t> m_freeBlocks;  // offset -> size, sorted for coalescing
+	std::unordered_map<size_t, size_t> m_usedBlocks;  // offset -> size
+	std::vector<bool> m_committedChunks;  // in use or not yet released, and only these need wiping at exit
+	std::vector<bool> m_lockedChunks;
+};
+
+
+
+// STL allocator for small secrets such as passwords. Falls back to the heap like the arena does,
+// in which case memory is still wiped before it is released.
+template <typename T>
+class SecureAllocator
+{
+public:
+	using value_type = T;
+
+	SecureAllocator() = default;
+	template <typename U>
+	SecureAllocator(const SecureAllocator<U>&) { }
+
+	T* allocate(size_t n)
+	{
+		void* ptr = SecureArena::GetInstance().Allocate(n * sizeof(T));
+		return static_cast<T*>(ptr != nullptr ? ptr : ::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* ptr, size_t n)
+	{
+		if (SecureArena::GetInstance().Free(ptr))
+			return;
+		SecureArena::Wipe(ptr, n * sizeof(T));
+		::operator delete(ptr);
+	}
+};
+
+template <typename T, typename U>
+inline bool operator==(const SecureAllocator<T>&, const SecureAllocator<U>&)	{ return true; }
+template <typename T, typename U>
+inline bool operator!=(const SecureAllocator<T>&, const SecureAllocator<U>&)	{ return false; }
+
+
+
+#endif // SECUREARENA_H
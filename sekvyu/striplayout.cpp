@@ -0,0 +1,139 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "striplayout.h"
+
+#include <algorithm>
+
+
+
+namespace {
+
+
+constexpr double k_defaultAspect = 1.5;  // until the first page is decoded
+
+
+}  // unnamed namespace
+
+
+
+StripLayout::StripLayout()
+	: m_sizes()
+	, m_columnWidth(0)
+	, m_aspectSum(0.0)
+	, m_numKnown(0)
+	, m_tops(1, 0.0)
+	, m_isDirty(false)
+{
+}
+
+
+void StripLayout::Reset(size_t pageCount)
+{
+	m_sizes.assign(pageCount, QSize());
+	m_aspectSum = 0.0;
+	m_numKnown = 0;
+	m_isDirty = true;
+}
+
+
+void StripLayout::SetColumnWidth(int width)
+{
+	if (width == m_columnWidth)
+		return;
+
+	m_columnWidth = width;
+	m_isDirty = true;
+}
+
+
+bool StripLayout::SetPageSize(size_t index, const QSize& fullSize)
+{
+	if (index >= m_sizes.size() || fullSize.isEmpty() || m_sizes[index].isValid())
+		return false;
+
+	m_sizes[index] = fullSize;
+	m_aspectSum += static_cast<double>(fullSize.height()) / fullSize.width();
+	++m_numKnown;
+	m_isDirty = true;
+	return true;
+}
+
+
+size_t StripLayout::GetPageCount() const
+{
+	return m_sizes.size();
+}
+
+
+int StripLayout::GetColumnWidth() const
+{
+	return m_columnWidth;
+}
+
+
+double StripLayout::GetTotalHeight() const
+{
+	Update();
+	return m_tops.back();
+}
+
+
+double StripLayout::GetPageTop(size_t index) const
+{
+	Update();
+	return m_tops[std::min(index, m_sizes.size())];
+}
+
+
+double StripLayout::GetPageHeight(size_t index) const
+{
+	Update();
+	return index < m_sizes.size() ? m_tops[index + 1] - m_tops[index] : 0.0;
+}
+
+
+size_t StripLayout::GetPageAt(double y) const
+{
+	Update();
+	if (m_sizes.empty())
+		return 0;
+
+	// the last top not below y
+	auto itr = std::upper_bound(m_tops.cbegin(), m_tops.cend() - 1, y);
+	const size_t index = itr == m_tops.cbegin() ? 0 : static_cast<size_t>(itr - m_tops.cbegin()) - 1;
+	return std::min(index, m_sizes.size() - 1);
+}
+
+
+// all pages at once; it is only a few thousand additions and happens once per decoded page at most
+void StripLayout::Update() const
+{
+	if (!m_isDirty)
+		return;
+
+	const double defaultAspect = m_numKnown > 0 ? m_aspectSum / m_numKnown : k_defaultAspect;
+	m_tops.resize(m_sizes.size() + 1);
+	m_tops[0] = 0.0;
+	for (size_t i = 0; i < m_sizes.size(); ++i) {
+		const QSize& size = m_sizes[i];
+		const double aspect = size.isValid() ? static_cast<double>(size.height()) / size.width() : defaultAspect;
+		m_tops[i + 1] = m_tops[i] + aspect * m_columnWidth;
+	}
+	m_isDirty = false;
+}
@@ -0,0 +1,63 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRIPLAYOUT_H
+#define STRIPLAYOUT_H
+
+#include <cstddef>
+#include <vector>
+
+#include <QSize>
+
+
+
+// Vertical positions of pages stacked in one column of a common width. Pages whose size is not known
+// until they are decoded are assumed to have the average aspect ratio of those which are.
+class StripLayout
+{
+public:
+	StripLayout();
+
+	void Reset(size_t pageCount);
+	void SetColumnWidth(int width);
+	bool SetPageSize(size_t index, const QSize& fullSize);  // true if the layout has changed
+
+	size_t GetPageCount() const;
+	int GetColumnWidth() const;
+	double GetTotalHeight() const;
+	double GetPageTop(size_t index) const;
+	double GetPageHeight(size_t index) const;
+	size_t GetPageAt(double y) const;  // clamped to the first and last pages
+
+
+private:
+	void Update() const;
+
+
+	std::vector<QSize> m_sizes;  // invalid while unknown
+	int m_columnWidth;
+	double m_aspectSum;  // height over width, of the pages with known sizes
+	size_t m_numKnown;
+
+	mutable std::vector<double> m_tops;  // one more than pages, the last being the total height
+	mutable bool m_isDirty;
+};
+
+
+
+#endif // STRIPLAYOUT_H
@@ -0,0 +1,302 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "taskscheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "trace.h"
+
+
+
+namespace {
+
+
+constexpr size_t k_notWorker = std::numeric_limits<size_t>::max();
+
+// which worker of which scheduler the current thread is, and the class of what it is running
+thread_local const TaskScheduler* t_scheduler = nullptr;
+thread_local size_t t_workerIndex = k_notWorker;
+thread_local TaskScheduler::Priority t_priority = TaskScheduler::Priority::Visible;
+
+
+inline size_t ToIndex(TaskScheduler::Priority priority)
+{
+	return static_cast<size_t>(priority);
+}
+
+
+}  // unnamed namespace
+
+
+
+CancellationToken CancellationToken::Create()
+{
+	CancellationToken token;
+	token.m_flag = std::make_shared<std::atomic<bool>>(false);
+	return token;
+}
+
+
+void CancellationToken::Cancel() const
+{
+	if (m_flag)
+		*m_flag = true;
+}
+
+
+bool CancellationToken::IsCancelled() const
+{
+	return m_flag && *m_flag;
+}
+
+
+
+TaskScheduler& TaskScheduler::GetInstance()
+{
+	static TaskScheduler s_instance;
+	return s_instance;
+}
+
+
+TaskScheduler::TaskScheduler()
+	: m_queues()
+	, m_workers()
+	, m_maxBackground(0)
+	, m_mutex()
+	, m_wakeUp()
+	, m_numQueued()
+	, m_numBackgroundRunning(0)
+	, m_isStopping(false)
+{
+	const size_t numWorkers = std::max(std::thread::hardware_concurrency(), 2u);
+	m_maxBackground = std::max<size_t>(numWorkers / 2, 1);  // as many as thumbnails used to have
+	m_numQueued.fill(0);
+
+	for (size_t i = 0; i <= numWorkers; ++i)
+		m_queues.emplace_back(new Queue);
+	for (size_t i = 0; i < numWorkers; ++i)
+		m_workers.emplace_back(&TaskScheduler::WorkerMain, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_wakeUp.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+
+// the job is queued while m_mutex is held, so a worker never takes it before it has been counted
+void TaskScheduler::Submit(Priority priority, const CancellationToken& token, Task&& task)
+{
+	const size_t queueIndex = t_scheduler == this ? t_workerIndex : m_workers.size();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		{
+			auto& queue = *m_queues[queueIndex];
+			std::lock_guard<std::mutex> queueLock(queue.mutex);
+			queue.jobs[ToIndex(priority)].push_back(Job{ priority, token, std::move(task) });
+		}
+		++m_numQueued[ToIndex(priority)];
+	}
+	m_wakeUp.notify_one();
+}
+
+
+void TaskScheduler::RunParallel(int numParts, const std::function<void(int part)>& func)
+{
+	if (numParts <= 0)
+		return;
+
+	// parts are claimed one at a time by whoever gets to them first
+	struct State
+	{
+		std::atomic<int> nextPart;
+		std::atomic<int> numDone;
+		std::mutex mutex;
+		std::condition_variable allDone;
+	};
+	auto state = std::make_shared<State>();
+	state->nextPart = 0;
+	state->numDone = 0;
+
+	// func is only used for parts claimed before the last one is done, i.e. before this returns
+	auto runParts = [state, &func, numParts]() {
+		for (int part = state->nextPart++; part < numParts; part = state->nextPart++) {
+			func(part);
+			if (++state->numDone == numParts) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->allDone.notify_all();
+			}
+		}
+	};
+
+	const int numHelpers = std::min(numParts - 1, static_cast<int>(m_workers.size()));
+	const Priority priority = t_scheduler == this ? t_priority : Priority::Visible;
+	for (int i = 0; i < numHelpers; ++i)
+		Submit(priority, CancellationToken(), [runParts](bool) { runParts(); } );
+	runParts();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->allDone.wait(lock, [&state, numParts]() { return state->numDone == numParts; });
+}
+
+
+size_t TaskScheduler::GetWorkerCount() const
+{
+	return m_workers.size();
+}
+
+
+void TaskScheduler::WorkerMain(size_t self)
+{
+	t_scheduler = this;
+	t_workerIndex = self;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_wakeUp.wait(lock, [this]() { return m_isStopping || HasRunnable(); });
+		if (m_isStopping)
+			return;
+
+		// a background slot is reserved before looking so that the limit holds exactly
+		const bool canRunBackground = m_numBackgroundRunning < m_maxBackground;
+		if (canRunBackground)
+			++m_numBackgroundRunning;
+		lock.unlock();
+
+		Job job;
+		const bool isFound = TryPop(self, canRunBackground, job);
+		const bool isBackground = isFound && IsBackground(job.priority);
+		lock.lock();
+		if (canRunBackground && !isBackground) {
+			--m_numBackgroundRunning;
+			if (m_numQueued[ToIndex(Priority::Thumbnail)] + m_numQueued[ToIndex(Priority::Idle)] > 0)
+				m_wakeUp.notify_one();  // someone may have gone to sleep because of the reservation
+		}
+		if (!isFound)
+			continue;  // taken by another worker before this one got to it
+		--m_numQueued[ToIndex(job.priority)];
+		lock.unlock();
+
+		{
+			TRACE_SCOPE("TaskScheduler::Run");
+			t_priority = job.priority;
+			job.task(job.token.IsCancelled());
+			job = Job();  // captures are released outside of the lock
+		}
+
+		lock.lock();
+		if (isBackground) {
+			--m_numBackgroundRunning;
+			m_wakeUp.notify_one();
+		}
+	}
+}
+
+
+bool TaskScheduler::HasRunnable() const
+{
+	if (m_numQueued[ToIndex(Priority::Visible)] + m_numQueued[ToIndex(Priority::Prefetch)] > 0)
+		return true;
+	return m_numBackgroundRunning < m_maxBackground &&
+		m_numQueued[ToIndex(Priority::Thumbnail)] + m_numQueued[ToIndex(Priority::Idle)] > 0;
+}
+
+
+// Class by class, a worker takes the newest job of its own, then the oldest shared one, then the
+// oldest one of another worker. Jobs of its own are mostly parts of what it has just been running.
+bool TaskScheduler::TryPop(size_t self, bool canRunBackground, Job& outJob)
+{
+	auto takeFrom = [&outJob](Queue& queue, size_t priority, bool isNewest) {
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		auto& jobs = queue.jobs[priority];
+		if (jobs.empty())
+			return false;
+		if (isNewest) {
+			outJob = std::move(jobs.back());
+			jobs.pop_back();
+		}
+		else {
+			outJob = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		return true;
+	};
+
+	const size_t numWorkers = m_workers.size();
+	for (size_t priority = 0; priority < k_numPriorities; ++priority) {
+		if (!canRunBackground && IsBackground(static_cast<Priority>(priority)))
+			break;  // background classes come last
+		if (takeFrom(*m_queues[self], priority, true) || takeFrom(*m_queues[numWorkers], priority, false))
+			return true;
+		for (size_t i = 1; i < numWorkers; ++i) {
+			if (takeFrom(*m_queues[(self + i) % numWorkers], priority, false))
+				return true;
+		}
+	}
+	return false;
+}
+
+
+bool TaskScheduler::IsBackground(Priority priority)
+{
+	return priority == Priority::Thumbnail || priority == Priority::Idle;
+}
+
+
+
+TaskGroup::TaskGroup()
+	: m_mutex()
+	, m_allDone()
+	, m_numUnfinished(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+
+void TaskGroup::Submit(TaskScheduler::Priority priority, const CancellationToken& token, TaskScheduler::Task&& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_numUnfinished;
+	}
+	TaskScheduler::GetInstance().Submit(priority, token, [this, task](bool isCancelled) {
+		task(isCancelled);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_numUnfinished == 0)
+			m_allDone.notify_all();
+	} );
+}
+
+
+void TaskGroup::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_allDone.wait(lock, [this]() { return m_numUnfinished == 0; });
+}
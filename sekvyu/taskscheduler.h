@@ -0,0 +1,149 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+// Shared flag telling a task that its result is no longer wanted. Copies refer to the same flag. A
+// default-constructed token is never cancelled.
+class CancellationToken
+{
+public:
+	CancellationToken() = default;
+	static CancellationToken Create();
+
+	void Cancel() const;
+	bool IsCancelled() const;
+
+
+private:
+	std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+
+
+// One set of worker threads for all background decoding and scaling, so that work of different
+// kinds does not compete for cores on equal terms. Each worker has a deque of its own, which tasks
+// submitted from it go to; tasks from other threads go to a shared one. Idle workers steal from the
+// others. The most urgent priority class that has anything queued always runs first, and the two
+// background classes are kept off some of the workers so that a page being waited for is never
+// stuck behind a screenful of thumbnails. Tasks are expected to take milliseconds, not seconds.
+class TaskScheduler
+{
+public:
+	enum class Priority
+	{
+		Visible,  // on screen and being waited for
+		Prefetch,  // pages the reader is about to turn to
+		Thumbnail,
+		Idle,  // anything that merely saves time later
+	};
+
+	// isCancelled is true if the token was cancelled before the task started, in which case the task
+	// should only report back. Running tasks are expected to check their tokens themselves.
+	using Task = std::function<void(bool isCancelled)>;
+
+	static TaskScheduler& GetInstance();
+
+	void Submit(Priority priority, const CancellationToken& token, Task&& task);  // from any thread
+
+	// Runs func for each part in [0, numParts) and returns once all are done. The calling thread
+	// takes parts as well, so this never waits on a worker which has yet to become free.
+	void RunParallel(int numParts, const std::function<void(int part)>& func);
+
+	size_t GetWorkerCount() const;
+
+
+private:
+	static constexpr size_t k_numPriorities = 4;
+
+	struct Job
+	{
+		Priority priority;
+		CancellationToken token;
+		Task task;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::array<std::deque<Job>, k_numPriorities> jobs;
+	};
+
+	TaskScheduler();
+	~TaskScheduler();
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	void WorkerMain(size_t self);
+	bool HasRunnable() const;
+	bool TryPop(size_t self, bool canRunBackground, Job& outJob);
+	static bool IsBackground(Priority priority);
+
+
+	std::vector<std::unique_ptr<Queue>> m_queues;  // one per worker, then the shared one
+	std::vector<std::thread> m_workers;
+	size_t m_maxBackground;  // workers which may run background classes at once
+
+	// guards the counts below, which are what sleeping workers wait on
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	std::array<size_t, k_numPriorities> m_numQueued;
+	size_t m_numBackgroundRunning;
+	bool m_isStopping;
+};
+
+
+
+// Tasks of one owner, such as a cache, which waits for all of them before it goes away. Tasks still
+// queued by then should have had their tokens cancelled so that they finish quickly.
+class TaskGroup
+{
+public:
+	TaskGroup();
+	~TaskGroup();
+
+	void Submit(TaskScheduler::Priority priority, const CancellationToken& token, TaskScheduler::Task&& task);
+	void Wait();
+
+
+private:
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+
+	std::mutex m_mutex;
+	std::condition_variable m_allDone;
+	size_t m_numUnfinished;
+};
+
+
+
+#endif // TASKSCHEDULER_H
@@ -0,0 +1,198 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailmodel.h"
+
+#include <limits>
+
+#include "imagedecoder.h"
+#include "imagescaler.h"
+#include "securearena.h"
+
+
+
+namespace {
+
+
+constexpr int k_thumbnailSize = 128;
+constexpr size_t k_budget = 64 * 1024 * 1024;  // about 1000 thumbnails
+
+
+size_t GetPixmapSize(const QPixmap& pixmap)
+{
+	return static_cast<size_t>(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+
+}  // unnamed namespace
+
+
+
+ThumbnailModel::ThumbnailModel(QObject* parent)
+	: QAbstractListModel(parent)
+	, m_archive()
+	, m_tasks()
+	, m_usage(0)
+	, m_placeholder(getThumbnailSize())
+	, m_entries()
+	, m_lru()
+	, m_pending()
+	, m_generation(0)
+	, m_visibleBegin(0)
+	, m_visibleEnd(std::numeric_limits<size_t>::max())  // everything until a view tells otherwise
+{
+	m_placeholder.fill(Qt::darkGray);
+}
+
+ThumbnailModel::~ThumbnailModel()
+{
+	for (const auto& pending : m_pending)
+		pending.second.Cancel();
+	m_tasks.Wait();
+}
+
+
+void ThumbnailModel::setArchive(const std::shared_ptr<Archive>& archive)
+{
+	beginResetModel();
+	++m_generation;  // results of queued and running tasks will be discarded
+	for (const auto& pending : m_pending)
+		pending.second.Cancel();
+
+	m_archive = archive;
+	m_entries.clear();
+	m_lru.clear();
+	m_pending.clear();
+	m_usage = 0;
+	endResetModel();
+}
+
+
+// [begin, end) should include some rows around the visible ones so that slight scrolling is free.
+// Pending thumbnails scrolled out of it are cancelled.
+void ThumbnailModel::setVisibleRange(size_t begin, size_t end)
+{
+	m_visibleBegin = begin;
+	m_visibleEnd = end;
+	for (const auto& pending : m_pending) {
+		if (pending.first < begin || pending.first >= end)
+			pending.second.Cancel();
+	}
+}
+
+
+QSize ThumbnailModel::getThumbnailSize()
+{
+	return QSize(k_thumbnailSize, k_thumbnailSize);
+}
+
+
+int ThumbnailModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid() || !m_archive)
+		return 0;
+	return static_cast<int>(m_archive->GetFileCount());
+}
+
+
+QVariant ThumbnailModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || !m_archive)
+		return QVariant();
+
+	const auto row = static_cast<size_t>(index.row());
+	if (role == Qt::DisplayRole)
+		return QString::number(row + 1);
+	else if (role == Qt::ToolTipRole)
+		return m_archive->GetFileName(row);
+	else if (role != Qt::DecorationRole)
+		return QVariant();
+
+	auto itr = m_entries.find(row);
+	if (itr != m_entries.end() && !itr->second.thumbnail.isNull())
+		return itr->second.thumbnail;
+	if (itr == m_entries.end())
+		schedule(row);
+	return m_placeholder;
+}
+
+
+// Thumbnails only run on the cores which pages being read leave free; see TaskScheduler
+void ThumbnailModel::schedule(size_t index) const
+{
+	if (m_pending.count(index) > 0)
+		return;
+
+	auto buffer = m_archive->GetFileData(index);
+	if (!buffer)
+		return;
+
+	auto token = CancellationToken::Create();
+	m_pending[index] = token;
+	const auto type = m_archive->GetFileType(index);
+	unsigned int generation = m_generation;
+	auto self = const_cast<ThumbnailModel*>(this);
+	m_tasks.Submit(TaskScheduler::Priority::Thumbnail, token, [self, buffer, type, generation, index, token](bool isStale) {
+		QImage thumbnail;
+		if (!isStale) {
+			QSize fullSize;
+			const QImage& image = ImageDecoder::Decode(buffer, type, getThumbnailSize(), fullSize, [token]() { return token.IsCancelled(); } );
+			if (!image.isNull())
+				thumbnail = SecureArena::CopyToArena(ImageScaler::Scale(image, getThumbnailSize()));
+		}
+		QMetaObject::invokeMethod(self, [self, generation, index, thumbnail, isStale]() {
+			self->onThumbnailReady(generation, index, thumbnail, isStale);
+		}, Qt::QueuedConnection);
+	} );
+}
+
+
+void ThumbnailModel::onThumbnailReady(unsigned int generation, size_t index, const QImage& thumbnail, bool isDropped)
+{
+	if (generation != m_generation)
+		return;  // belongs to a previous archive
+
+	const auto& modelIndex = createIndex(static_cast<int>(index), 0);
+	m_pending.erase(index);
+	if (isDropped) {
+		// asked for again once it is painted, which may have happened while this was pending
+		if (index >= m_visibleBegin && index < m_visibleEnd)
+			emit dataChanged(modelIndex, modelIndex, { Qt::DecorationRole });
+		return;
+	}
+
+	m_lru.push_front(index);
+	auto& entry = m_entries[index];
+	entry.thumbnail = QPixmap::fromImage(thumbnail);
+	entry.lruPos = m_lru.begin();
+	m_usage += GetPixmapSize(entry.thumbnail);
+	evict();
+
+	emit dataChanged(modelIndex, modelIndex, { Qt::DecorationRole });
+}
+
+
+void ThumbnailModel::evict()
+{
+	while (m_usage > k_budget && m_lru.size() > 1) {
+		auto entry = m_entries.find(m_lru.back());
+		m_usage -= GetPixmapSize(entry->second.thumbnail);
+		m_entries.erase(entry);
+		m_lru.pop_back();
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILMODEL_H
+#define THUMBNAILMODEL_H
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include <QAbstractListModel>
+#include <QImage>
+#include <QPixmap>
+
+#include "archive.h"
+#include "taskscheduler.h"
+
+
+
+// List of an archive's images as thumbnails. A thumbnail is only made once a view asks for it, i.e.
+// once its cell is painted, as background work on the shared task scheduler. Finished ones are kept
+// within a small budget and requests which leave the visible range are cancelled.
+class ThumbnailModel : public QAbstractListModel
+{
+	Q_OBJECT
+
+public:
+	explicit ThumbnailModel(QObject* parent = nullptr);
+	~ThumbnailModel();
+
+	void setArchive(const std::shared_ptr<Archive>& archive);
+	void setVisibleRange(size_t begin, size_t end);
+	static QSize getThumbnailSize();
+
+	virtual int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+
+private:
+	struct Entry
+	{
+		QPixmap thumbnail;  // null if decoding has failed
+		std::list<size_t>::iterator lruPos;
+	};
+
+	void schedule(size_t index) const;
+	void onThumbnailReady(unsigned int generation, size_t index, const QImage& thumbnail, bool isDropped);
+	void evict();
+
+
+	std::shared_ptr<Archive> m_archive;
+	mutable TaskGroup m_tasks;
+	size_t m_usage;
+	QPixmap m_placeholder;
+
+	std::unordered_map<size_t, Entry> m_entries;
+	std::list<size_t> m_lru;  // most recently made at front
+	mutable std::unordered_map<size_t, CancellationToken> m_pending;  // requested from data()
+
+	unsigned int m_generation;  // of the archive, for results of tasks which were running when it changed
+	size_t m_visibleBegin;
+	size_t m_visibleEnd;
+};
+
+
+
+#endif // THUMBNAILMODEL_H
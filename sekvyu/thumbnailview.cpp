@@ -0,0 +1,112 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailview.h"
+
+#include <algorithm>
+
+#include <QScrollBar>
+
+
+
+namespace {
+
+
+constexpr int k_cellSpacing = 24;  // room for the page number below a thumbnail
+
+
+}  // unnamed namespace
+
+
+
+ThumbnailView::ThumbnailView(QWidget* parent)
+	: QListView(parent)
+	, m_model()
+{
+	const auto& thumbnailSize = ThumbnailModel::getThumbnailSize();
+	setViewMode(QListView::IconMode);
+	setMovement(QListView::Static);
+	setResizeMode(QListView::Adjust);
+	setUniformItemSizes(true);  // lays out thousands of cells without asking for any of them
+	setLayoutMode(QListView::Batched);
+	setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);  // scroll bar values are in pixels
+	setIconSize(thumbnailSize);
+	setGridSize(thumbnailSize + QSize(k_cellSpacing / 2, k_cellSpacing));
+	setSelectionMode(QAbstractItemView::SingleSelection);
+	setEditTriggers(QAbstractItemView::NoEditTriggers);
+	setModel(&m_model);
+
+	QObject::connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &ThumbnailView::updateVisibleRange);
+	QObject::connect(this, &QListView::clicked, this, [this](const QModelIndex& index) {
+		emit pageActivated(static_cast<size_t>(index.row()));
+	} );
+}
+
+
+void ThumbnailView::setArchive(const std::shared_ptr<Archive>& archive)
+{
+	m_model.setArchive(archive);
+	updateVisibleRange();
+}
+
+
+void ThumbnailView::setCurrentPage(size_t index)
+{
+	const auto& modelIndex = m_model.index(static_cast<int>(index));
+	if (!modelIndex.isValid() || modelIndex == currentIndex())
+		return;
+
+	setCurrentIndex(modelIndex);
+	scrollTo(modelIndex);
+}
+
+
+// The rows in view plus one screen above and below. Cells sit on a uniform grid, so this needs no
+// hit-testing, which would miss in the gaps between cells.
+void ThumbnailView::updateVisibleRange()
+{
+	const auto rowCount = static_cast<size_t>(m_model.rowCount());
+	if (rowCount == 0 || !isVisible()) {
+		m_model.setVisibleRange(0, 0);
+		return;
+	}
+
+	const auto& grid = gridSize();
+	const auto columnCount = static_cast<size_t>(std::max(viewport()->width() / grid.width(), 1));
+	const int scrollPos = verticalScrollBar()->value();
+	const auto firstLine = static_cast<size_t>(scrollPos / grid.height());
+	const auto lastLine = static_cast<size_t>((scrollPos + viewport()->height()) / grid.height());
+	const size_t begin = firstLine * columnCount;
+	const size_t end = (lastLine + 1) * columnCount;
+	const size_t margin = end - begin;
+	m_model.setVisibleRange(begin > margin ? begin - margin : 0, std::min(end + margin, rowCount));
+}
+
+
+void ThumbnailView::resizeEvent(QResizeEvent* event)
+{
+	QListView::resizeEvent(event);
+	updateVisibleRange();
+}
+
+
+void ThumbnailView::showEvent(QShowEvent* event)
+{
+	QListView::showEvent(event);
+	updateVisibleRange();
+}
@@ -0,0 +1,62 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILVIEW_H
+#define THUMBNAILVIEW_H
+
+#include <memory>
+
+#include <QListView>
+
+#include "archive.h"
+#include "thumbnailmodel.h"
+
+
+
+// Grid of thumbnails of all images in an archive. Only cells in view are ever made.
+class ThumbnailView : public QListView
+{
+	Q_OBJECT
+
+public:
+	explicit ThumbnailView(QWidget* parent = nullptr);
+
+	void setArchive(const std::shared_ptr<Archive>& archive);
+
+
+signals:
+	void pageActivated(size_t index);
+
+
+public slots:
+	void setCurrentPage(size_t index);
+
+
+private:
+	void updateVisibleRange();
+
+	virtual void resizeEvent(QResizeEvent* event) override;
+	virtual void showEvent(QShowEvent* event) override;
+
+
+	ThumbnailModel m_model;
+};
+
+
+
+#endif // THUMBNAILVIEW_H
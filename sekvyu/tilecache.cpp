@@ -0,0 +1,279 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilecache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "imagedecoder.h"
+#include "securearena.h"
+
+
+
+namespace {
+
+
+constexpr int k_tileSize = 512;
+constexpr size_t k_budget = 96 * 1024 * 1024;  // about 90 full tiles, a few screens' worth
+
+
+inline uint64_t MakeKey(int level, int column, int row)
+{
+	return (static_cast<uint64_t>(level) << 56) | (static_cast<uint64_t>(column) << 28) | static_cast<uint64_t>(row);
+}
+
+inline size_t GetTileBytes(const QImage& tile)
+{
+	return static_cast<size_t>(tile.sizeInBytes());
+}
+
+inline QSize GetLevelSize(const QSize& size, int level)
+{
+	return QSize(std::max((size.width() + (1 << level) - 1) >> level, 1), std::max((size.height() + (1 << level) - 1) >> level, 1));
+}
+
+
+// straight into the arena, without the heap copy QImage::copy() would make first
+QImage CutTile(const QImage& band, const QRect& rect)
+{
+	const QRect& clipped = rect & band.rect();
+	if (band.isNull() || clipped.isEmpty())
+		return QImage();
+
+	QImage tile = SecureArena::CreateImage(clipped.size(), band.format());
+	const int bytesPerPixel = band.depth() / 8;
+	for (int y = 0; y < clipped.height(); ++y)
+		std::memcpy(tile.scanLine(y), band.constScanLine(clipped.top() + y) + clipped.left() * bytesPerPixel, static_cast<size_t>(clipped.width()) * bytesPerPixel);
+	return tile;
+}
+
+
+}  // unnamed namespace
+
+
+
+TileCache::TileCache(QObject* parent)
+	: QObject(parent)
+	, m_archive()
+	, m_tasks()
+	, m_index(0)
+	, m_fullSize()
+	, m_isTileable(false)
+	, m_usage(0)
+	, m_entries()
+	, m_lru()
+	, m_pending()
+	, m_batches()
+	, m_batchCount(0)
+	, m_generation(0)
+	, m_visibleLevel(-1)
+	, m_visibleTiles()
+{
+}
+
+TileCache::~TileCache()
+{
+	clear();
+	m_tasks.Wait();
+}
+
+
+void TileCache::setArchive(const std::shared_ptr<Archive>& archive)
+{
+	clear();
+	m_archive = archive;
+	m_index = 0;
+	m_fullSize = QSize();
+	m_isTileable = false;
+}
+
+
+bool TileCache::setPage(size_t index, const QSize& fullSize)
+{
+	if (index == m_index && fullSize == m_fullSize)
+		return m_isTileable;
+
+	clear();
+	m_index = index;
+	m_fullSize = fullSize;
+	m_isTileable = m_archive && fullSize.isValid() && ImageDecoder::CanDecodeRegion(m_archive->GetFileType(index));
+	return m_isTileable;
+}
+
+
+void TileCache::clear()
+{
+	++m_generation;  // results of queued and running tasks will be discarded
+	for (const auto& batch : m_batches)
+		batch.second.token.Cancel();
+	m_entries.clear();
+	m_lru.clear();
+	m_pending.clear();
+	m_batches.clear();
+	m_usage = 0;
+}
+
+
+// batches with no tile left in view are cancelled
+void TileCache::setVisibleTiles(int level, const QRect& tiles)
+{
+	m_visibleLevel = level;
+	m_visibleTiles = tiles;
+	for (const auto& batch : m_batches) {
+		if (batch.second.level != level || !batch.second.tiles.intersects(tiles))
+			batch.second.token.Cancel();
+	}
+}
+
+
+bool TileCache::lookup(int level, int column, int row, QImage& outTile)
+{
+	auto itr = m_entries.find(MakeKey(level, column, row));
+	if (itr == m_entries.end())
+		return false;
+
+	m_lru.splice(m_lru.begin(), m_lru, itr->second.lruPos);
+	outTile = itr->second.tile;
+	return true;
+}
+
+
+// A baseline JPEG cannot be entered midway, so each decode runs through every row above its region.
+// Decoding the bounding box of the missing tiles at once, and cutting it up, pays for that once
+// per batch rather than once per tile.
+void TileCache::request(int level, const QRect& tiles)
+{
+	if (!m_isTileable)
+		return;
+
+	QRect missing;
+	for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+		for (int column = tiles.left(); column <= tiles.right(); ++column) {
+			const uint64_t key = MakeKey(level, column, row);
+			if (m_entries.count(key) == 0 && m_pending.count(key) == 0)
+				missing |= QRect(column, row, 1, 1);
+		}
+	}
+	if (missing.isEmpty())
+		return;
+
+	auto buffer = m_archive->GetFileData(m_index);
+	if (!buffer)
+		return;
+
+	// where each tile is in the decoded band; tiles in the box which are already there are skipped
+	const QRect region = getTileRect(level, missing.left(), missing.top(), m_fullSize) | getTileRect(level, missing.right(), missing.bottom(), m_fullSize);
+	std::vector<std::pair<uint64_t, QRect>> cuts;
+	for (int row = missing.top(); row <= missing.bottom(); ++row) {
+		for (int column = missing.left(); column <= missing.right(); ++column) {
+			const uint64_t key = MakeKey(level, column, row);
+			if (m_entries.count(key) > 0 || m_pending.count(key) > 0)
+				continue;
+			const QPoint offset((column - missing.left()) * k_tileSize, (row - missing.top()) * k_tileSize);
+			cuts.emplace_back(key, QRect(offset, GetLevelSize(getTileRect(level, column, row, m_fullSize).size(), level)));
+			m_pending.insert(key);
+		}
+	}
+
+	const auto type = m_archive->GetFileType(m_index);
+	const QSize outputSize = GetLevelSize(region.size(), level);
+	auto token = CancellationToken::Create();
+	const unsigned int batchId = ++m_batchCount;
+	m_batches[batchId] = Batch{ level, missing, token };
+	unsigned int generation = m_generation;
+	m_tasks.Submit(TaskScheduler::Priority::Visible, token, [this, buffer, type, region, outputSize, generation, batchId, cuts, token](bool isStale) {
+		std::vector<std::pair<uint64_t, QImage>> decoded;
+		if (!isStale) {
+			const QImage& band = ImageDecoder::DecodeRegion(buffer, type, region, outputSize, [token]() { return token.IsCancelled(); } );
+			isStale = token.IsCancelled();
+			decoded.reserve(cuts.size());
+			for (const auto& cut : cuts)
+				decoded.emplace_back(cut.first, isStale ? QImage() : CutTile(band, cut.second));
+		}
+		else {
+			for (const auto& cut : cuts)
+				decoded.emplace_back(cut.first, QImage());
+		}
+		QMetaObject::invokeMethod(this, [this, generation, batchId, decoded, isStale]() {
+			onBatchDecoded(generation, batchId, decoded, isStale);
+		}, Qt::QueuedConnection);
+	} );
+}
+
+
+int TileCache::getTileSize()
+{
+	return k_tileSize;
+}
+
+
+// the coarsest level which still has at least one pixel for each pixel on screen
+int TileCache::getLevelForScale(double scale, const QSize& fullSize)
+{
+	int maxLevel = 0;
+	while ((std::max(fullSize.width(), fullSize.height()) >> (maxLevel + 1)) >= k_tileSize)
+		++maxLevel;
+
+	if (scale >= 1.0)
+		return 0;
+	const int level = static_cast<int>(std::floor(std::log2(1.0 / scale)));
+	return std::min(std::max(level, 0), maxLevel);
+}
+
+
+QRect TileCache::getTileRect(int level, int column, int row, const QSize& fullSize)
+{
+	const int span = k_tileSize << level;
+	return QRect(column * span, row * span, span, span) & QRect(QPoint(0, 0), fullSize);
+}
+
+
+void TileCache::onBatchDecoded(unsigned int generation, unsigned int batchId, const std::vector<std::pair<uint64_t, QImage>>& tiles, bool isDropped)
+{
+	if (generation != m_generation)
+		return;  // belongs to a previous page
+
+	m_batches.erase(batchId);
+	for (const auto& tile : tiles) {
+		m_pending.erase(tile.first);
+		if (isDropped)
+			continue;  // asked for again if it comes into view
+
+		m_lru.push_front(tile.first);
+		m_entries[tile.first] = Entry{ tile.second, m_lru.begin() };
+		m_usage += GetTileBytes(tile.second);
+	}
+	if (isDropped)
+		return;
+
+	evict();
+	emit tileReady();
+}
+
+
+void TileCache::evict()
+{
+	while (m_usage > k_budget && m_lru.size() > 1) {
+		auto entry = m_entries.find(m_lru.back());
+		m_usage -= GetTileBytes(entry->second.tile);
+		m_entries.erase(entry);
+		m_lru.pop_back();
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <QImage>
+#include <QObject>
+#include <QRect>
+#include <QSize>
+
+#include "archive.h"
+#include "taskscheduler.h"
+
+
+
+// Tiles of one page at a time for zooming into images too large to keep decoded as a whole. Level 0
+// is the full resolution and each further level halves it. Missing tiles are decoded in batches as
+// visible work on the shared task scheduler and kept within a fixed budget, so memory does not depend on the image
+// dimensions. Only formats which ImageDecoder can decode by region are supported. All public
+// methods are meant to be called from the GUI thread.
+class TileCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TileCache(QObject* parent = nullptr);
+	~TileCache();
+
+	void setArchive(const std::shared_ptr<Archive>& archive);
+	bool setPage(size_t index, const QSize& fullSize);  // false if the page cannot be tiled
+	void setVisibleTiles(int level, const QRect& tiles);  // in tile units of that level; others are skipped
+
+	bool lookup(int level, int column, int row, QImage& outTile);  // a null outTile means decoding has failed
+	void request(int level, const QRect& tiles);  // those of tiles neither cached nor pending, in one decode
+
+	static int getTileSize();
+	static int getLevelForScale(double scale, const QSize& fullSize);  // scale is view pixels per image pixel
+	static QRect getTileRect(int level, int column, int row, const QSize& fullSize);  // in full-resolution pixels
+
+
+signals:
+	void tileReady();
+
+
+private:
+	struct Entry
+	{
+		QImage tile;
+		std::list<uint64_t>::iterator lruPos;
+	};
+
+	// tiles decoded together, which are cancelled together
+	struct Batch
+	{
+		int level;
+		QRect tiles;
+		CancellationToken token;
+	};
+
+	void clear();
+	void onBatchDecoded(unsigned int generation, unsigned int batchId, const std::vector<std::pair<uint64_t, QImage>>& tiles, bool isDropped);
+	void evict();
+
+
+	std::shared_ptr<Archive> m_archive;
+	TaskGroup m_tasks;
+	size_t m_index;
+	QSize m_fullSize;
+	bool m_isTileable;
+	size_t m_usage;
+
+	std::unordered_map<uint64_t, Entry> m_entries;
+	std::list<uint64_t> m_lru;  // most recently used at front
+	std::unordered_set<uint64_t> m_pending;
+	std::unordered_map<unsigned int, Batch> m_batches;
+	unsigned int m_batchCount;
+
+	unsigned int m_generation;  // of the page, for results of tasks which were running when it changed
+	int m_visibleLevel;  // batches entirely outside of these are cancelled
+	QRect m_visibleTiles;
+};
+
+
+
+#endif // TILECACHE_H
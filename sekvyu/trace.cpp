@@ -0,0 +1,187 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#ifdef SEKVYU_TRACING
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+
+
+constexpr size_t k_ringSize = 1 << 16;  // events per thread; a power of two
+
+
+struct Event
+{
+	const char* name;
+	int64_t begin;
+	int64_t end;
+};
+
+struct ThreadBuffer
+{
+	int threadIndex;
+	std::unique_ptr<Event[]> events;
+	std::atomic<uint64_t> count;  // including overwritten ones
+	std::atomic<bool> isWriting;  // waited for by Finish() after recording is disabled
+};
+
+
+std::atomic<bool> g_isEnabled(false);
+std::string g_outputPath;
+std::chrono::steady_clock::time_point g_startTime;
+
+// buffers outlive their threads, since pool threads come and go
+std::mutex g_buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+
+
+ThreadBuffer* GetThreadBuffer()
+{
+	thread_local ThreadBuffer* t_buffer = nullptr;
+	if (t_buffer == nullptr) {
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+		buffer->events.reset(new Event[k_ringSize]);
+		buffer->count = 0;
+		buffer->isWriting = false;
+
+		std::lock_guard<std::mutex> lock(g_buffersMutex);
+		buffer->threadIndex = static_cast<int>(g_buffers.size());
+		t_buffer = buffer.get();
+		g_buffers.push_back(std::move(buffer));
+	}
+	return t_buffer;
+}
+
+
+void WriteJsonString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str != '\0'; ++str) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', file);
+		fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+
+}  // unnamed namespace
+
+
+
+void Trace::Initialize()
+{
+	const char* path = getenv("SEKVYU_TRACE");
+	if (path == nullptr || *path == '\0')
+		return;
+
+	g_outputPath = path;
+	g_startTime = std::chrono::steady_clock::now();
+	GetThreadBuffer();  // the calling thread becomes thread 0
+	g_isEnabled = true;
+}
+
+
+void Trace::Finish()
+{
+	if (!g_isEnabled)
+		return;
+	g_isEnabled = false;  // seq_cst, as in Record(), so that a writer either sees this or is waited for
+
+	std::lock_guard<std::mutex> lock(g_buffersMutex);
+	for (const auto& buffer : g_buffers) {
+		while (buffer->isWriting)
+			std::this_thread::yield();
+	}
+
+	FILE* file = fopen(g_outputPath.c_str(), "w");
+	if (file == nullptr)
+		return;
+
+	fputs("{\"traceEvents\":[\n", file);
+	fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GUI\"}}", file);
+
+	for (const auto& buffer : g_buffers) {
+		const uint64_t count = buffer->count.load(std::memory_order_acquire);
+		const uint64_t first = count > k_ringSize ? count - k_ringSize : 0;
+		for (uint64_t i = first; i < count; ++i) {
+			const auto& event = buffer->events[i & (k_ringSize - 1)];
+			fputs(",\n{\"name\":", file);
+			WriteJsonString(file, event.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->threadIndex, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+		}
+	}
+
+	fputs("\n]}\n", file);
+	fclose(file);
+}
+
+
+bool Trace::IsEnabled()
+{
+	return g_isEnabled.load(std::memory_order_relaxed);
+}
+
+
+// never 0 once enabled, which Scope takes as "not recording"
+int64_t Trace::GetTimestamp()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_startTime).count() + 1;
+}
+
+
+// The flag is raised before checking whether recording is still on, so Finish() cannot start
+// reading the ring in between.
+void Trace::Record(const char* name, int64_t begin, int64_t end)
+{
+	if (!IsEnabled())
+		return;
+
+	auto buffer = GetThreadBuffer();
+	buffer->isWriting = true;
+	if (g_isEnabled) {
+		const uint64_t index = buffer->count.load(std::memory_order_relaxed);
+		buffer->events[index & (k_ringSize - 1)] = Event{ name, begin, end };
+		buffer->count.store(index + 1, std::memory_order_release);
+	}
+	buffer->isWriting.store(false, std::memory_order_release);
+}
+
+
+#else
+
+void Trace::Initialize()									{ }
+void Trace::Finish()										{ }
+bool Trace::IsEnabled()										{ return false; }
+int64_t Trace::GetTimestamp()								{ return 0; }
+void Trace::Record(const char*, int64_t, int64_t)			{ }
+
+#endif  // SEKVYU_TRACING
@@ -0,0 +1,82 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+
+
+
+// Timing spans for finding out where the time of a slow page turn went. Only built in with
+// "qmake CONFIG+=tracing"; otherwise TRACE_SCOPE expands to nothing. Even when built in, nothing
+// is recorded unless the environment variable SEKVYU_TRACE names a file, to which the spans are
+// written at exit in Chrome's trace event format (chrome://tracing or ui.perfetto.dev).
+//
+// Each thread records into a ring buffer of its own, so recording takes no lock. Only the latest
+// spans of each thread are kept.
+class Trace
+{
+public:
+	static void Initialize();  // to be called at start-up, before any span
+	static void Finish();  // stops recording on all threads and writes the trace file
+
+	static bool IsEnabled();
+	static int64_t GetTimestamp();  // nanoseconds
+	static void Record(const char* name, int64_t begin, int64_t end);
+
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char* name)
+			: m_name(name)
+			, m_begin(IsEnabled() ? GetTimestamp() : 0)
+		{
+		}
+
+		~Scope()
+		{
+			if (m_begin != 0)
+				Record(m_name, m_begin, GetTimestamp());
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+
+	private:
+		const char* m_name;  // must be a literal or otherwise outlive the process
+		int64_t m_begin;
+	};
+};
+
+
+
+#ifdef SEKVYU_TRACING
+	#define TRACE_CONCAT_IMPL(a, b)		a##b
+	#define TRACE_CONCAT(a, b)			TRACE_CONCAT_IMPL(a, b)
+	#define TRACE_SCOPE(name)			Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#else
+	#define TRACE_SCOPE(name)
+#endif  // SEKVYU_TRACING
+
+
+
+#endif // TRACE_H
@@ -0,0 +1,222 @@
+/*
+ *  This file is a part of Sekvyu, a 7z archive image viewer.
+ *  Copyright (C) 2018 Mifan Bang <https://debug.tw>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks of TaskScheduler's guarantees which the viewer's responsiveness depends on. Plain C++ with
+// no test framework, like the scheduler itself; prints each failure and exits non-zero if any.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "taskscheduler.h"
+
+
+
+namespace {
+
+
+using Clock = std::chrono::steady_clock;
+using Priority = TaskScheduler::Priority;
+
+constexpr auto k_taskLength = std::chrono::milliseconds(200);
+constexpr auto k_cancelLatency = std::chrono::milliseconds(50);
+constexpr auto k_deadlockTimeout = std::chrono::seconds(10);
+
+int g_numFailures = 0;
+
+
+#define CHECK(condition)	Check((condition), #condition, __LINE__)
+
+void Check(bool isPassed, const char* expr, int line)
+{
+	if (isPassed)
+		return;
+	std::fprintf(stderr, "  FAILED at line %d: %s\n", line, expr);
+	++g_numFailures;
+}
+
+
+// holds workers busy until opened
+class Gate
+{
+public:
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this]() { return m_isOpen; });
+	}
+
+	void Open()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isOpen = true;
+		}
+		m_condition.notify_all();
+	}
+
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_isOpen = false;
+};
+
+
+// Every worker is offered background work. Half of them at most take it, so a visible task
+// submitted afterwards starts right away instead of after a background task has finished.
+void TestVisibleIsNotStuckBehindBackground()
+{
+	std::fprintf(stderr, "visible work behind background work\n");
+	auto& scheduler = TaskScheduler::GetInstance();
+	const size_t numWorkers = scheduler.GetWorkerCount();
+
+	std::atomic<int> numRunning(0);
+	std::atomic<int> maxRunning(0);
+	TaskGroup group;
+	for (size_t i = 0; i < numWorkers * 2; ++i) {
+		group.Submit(i % 2 == 0 ? Priority::Idle : Priority::Thumbnail, CancellationToken(), [&](bool) {
+			const int running = ++numRunning;
+			int seen = maxRunning;
+			while (running > seen && !maxRunning.compare_exchange_weak(seen, running)) { }
+			std::this_thread::sleep_for(k_taskLength);
+			--numRunning;
+		} );
+	}
+	std::this_thread::sleep_for(k_taskLength / 4);  // let the background tasks get going
+
+	std::promise<Clock::time_point> started;
+	const auto submitted = Clock::now();
+	group.Submit(Priority::Visible, CancellationToken(), [&started](bool) { started.set_value(Clock::now()); } );
+	auto future = started.get_future();
+	CHECK(future.wait_for(k_taskLength * 4) == std::future_status::ready);
+	if (future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		CHECK(future.get() - submitted < k_taskLength);
+
+	group.Wait();
+	CHECK(maxRunning >= 1);
+	CHECK(static_cast<size_t>(maxRunning) <= std::max<size_t>(numWorkers / 2, 1));
+}
+
+
+// A queued task whose token is cancelled reports back without doing its work, and a running one
+// which checks its token stops soon after it is cancelled.
+void TestCancellation()
+{
+	std::fprintf(stderr, "cancellation\n");
+	auto& scheduler = TaskScheduler::GetInstance();
+	TaskGroup group;
+
+	// every worker is busy, so the next task stays queued
+	Gate gate;
+	for (size_t i = 0; i < scheduler.GetWorkerCount(); ++i)
+		group.Submit(Priority::Visible, CancellationToken(), [&gate](bool) { gate.Wait(); } );
+
+	auto queuedToken = CancellationToken::Create();
+	std::atomic<bool> isWorkDone(false);
+	std::promise<bool> queuedResult;
+	group.Submit(Priority::Prefetch, queuedToken, [&](bool isCancelled) {
+		if (!isCancelled)
+			isWorkDone = true;
+		queuedResult.set_value(isCancelled);
+	} );
+	queuedToken.Cancel();
+	gate.Open();
+
+	auto queuedFuture = queuedResult.get_future();
+	CHECK(queuedFuture.wait_for(k_taskLength) == std::future_status::ready);
+	if (queuedFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		CHECK(queuedFuture.get());
+	CHECK(!isWorkDone);
+
+	// a task which polls its token between small steps, like a decode reading its input
+	auto runningToken = CancellationToken::Create();
+	std::promise<void> running;
+	std::promise<Clock::time_point> stopped;
+	group.Submit(Priority::Visible, runningToken, [&, runningToken](bool) {
+		running.set_value();
+		while (!runningToken.IsCancelled())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		stopped.set_value(Clock::now());
+	} );
+	running.get_future().wait();
+	const auto cancelled = Clock::now();
+	runningToken.Cancel();
+
+	auto stoppedFuture = stopped.get_future();
+	CHECK(stoppedFuture.wait_for(k_taskLength) == std::future_status::ready);
+	if (stoppedFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		CHECK(stoppedFuture.get() - cancelled < k_cancelLatency);
+
+	group.Wait();
+}
+
+
+// Parts of a RunParallel called from a worker go to that worker's own queue. With every worker
+// doing the same, none is free to take them, so the callers must get through them themselves.
+void TestNestedRunParallel()
+{
+	std::fprintf(stderr, "RunParallel from inside workers\n");
+	auto& scheduler = TaskScheduler::GetInstance();
+	const size_t numTasks = scheduler.GetWorkerCount() * 3;
+
+	std::atomic<int> numParts(0);
+	auto allDone = std::async(std::launch::async, [&]() {
+		TaskGroup group;
+		for (size_t i = 0; i < numTasks; ++i) {
+			group.Submit(Priority::Visible, CancellationToken(), [&](bool) {
+				TaskScheduler::GetInstance().RunParallel(16, [&](int) {
+					TaskScheduler::GetInstance().RunParallel(4, [&](int) { ++numParts; } );
+				} );
+			} );
+		}
+	} );
+
+	if (allDone.wait_for(k_deadlockTimeout) != std::future_status::ready) {
+		std::fprintf(stderr, "  FAILED: deadlocked\n");
+		std::fflush(stderr);
+		std::_Exit(EXIT_FAILURE);  // the workers could never be joined
+	}
+	CHECK(numParts == static_cast<int>(numTasks) * 16 * 4);
+}
+
+
+}  // unnamed namespace
+
+
+
+int main()
+{
+	std::fprintf(stderr, "%zu workers\n", TaskScheduler::GetInstance().GetWorkerCount());
+	TestVisibleIsNotStuckBehindBackground();
+	TestCancellation();
+	TestNestedRunParallel();
+
+	if (g_numFailures > 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", g_numFailures);
+		return EXIT_FAILURE;
+	}
+	std::fprintf(stderr, "all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+TARGET = taskscheduler-test
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle qt
+
+CONFIG(tracing) {
+    DEFINES += SEKVYU_TRACING
+}
+
+
+# build configuration-specific
+CONFIG(debug, debug|release) {
+    MY_BUILD_CONFIG = debug
+}
+CONFIG(release, debug|release) {
+    MY_BUILD_CONFIG = release
+}
+
+unix {
+    LIBS += -pthread
+    QMAKE_CXXFLAGS += -pthread
+}
+
+INCLUDEPATH += "../sekvyu/"
+
+# output/intermediate folders
+DESTDIR = ../build/bin/$${MY_BUILD_CONFIG}
+OBJECTS_DIR = ../build/obj/tests/$${MY_BUILD_CONFIG}
+PRECOMPILED_DIR = ../build/tests
+
+
+SOURCES += \
+    taskscheduler_test.cpp \
+    ../sekvyu/taskscheduler.cpp \
+    ../sekvyu/trace.cpp
+
+HEADERS += \
+    ../sekvyu/taskscheduler.h \
+    ../sekvyu/trace.h